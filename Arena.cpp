@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "Arena.h"
+
+const size_t Arena::kMinExtraBlock;
+
+Arena::~Arena() {
+    this->reset();
+    delete[] fBlock;
+}
+
+void* Arena::alloc(size_t bytes, size_t align) {
+    size_t start = (fUsed + align - 1) & ~(align - 1);
+    if (start + bytes <= fSize) {
+        fUsed = start + bytes;
+        return fBlock + start;
+    }
+
+    // doesn't fit, so get it from the heap for now, from the newest overflow block if it has
+    // room (new[] is aligned enough for anything)
+    fOverflow += bytes + align;
+    start = (fExtraUsed + align - 1) & ~(align - 1);
+    if (!fOverflowBlocks.empty() && start + bytes <= fExtraSize) {
+        fExtraUsed = start + bytes;
+        return fOverflowBlocks.back() + start;
+    }
+
+    fExtraSize = std::max(bytes, kMinExtraBlock);
+    fExtraUsed = bytes;
+    char* block = new char[fExtraSize];
+    fOverflowBlocks.push_back(block);
+    return block;
+}
+
+void Arena::reset() {
+    for (char* block : fOverflowBlocks) {
+        delete[] block;
+    }
+    fOverflowBlocks.clear();
+    fExtraSize = fExtraUsed = 0;
+
+    // make the block big enough for everything the last draw needed
+    if (fOverflow > 0) {
+        size_t newSize = std::max(fSize * 2, fSize + fOverflow);
+        delete[] fBlock;
+        fBlock = new char[newSize];
+        fSize = newSize;
+        fOverflow = 0;
+    }
+    fUsed = 0;
+}
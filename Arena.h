@@ -0,0 +1,65 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef Arena_DEFINED
+#define Arena_DEFINED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ *  Scratch memory for a draw. Allocating just bumps a pointer through one big block, & reset()
+ *  frees everything at once. If a draw needs more than the block holds, the extra comes from
+ *  the heap & the block grows to fit it at the next reset(), so once the arena has seen the
+ *  biggest draw it stops allocating from the heap at all.
+ *
+ *  An arena that is never reset works as storage that lasts as long as it does: the extra
+ *  is bumped through heap blocks of at least kMinExtraBlock bytes, so small allocations are
+ *  still packed together.
+ */
+class Arena {
+public:
+    Arena() : fBlock(nullptr), fSize(0), fUsed(0), fOverflow(0), fExtraSize(0), fExtraUsed(0) {}
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     *  Returns room for count T's, which is NOT initialized & lasts until the next reset().
+     *  T can't need a destructor, since the arena never calls one.
+     */
+    template <typename T> T* makeArray(int count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena never calls destructors");
+        return static_cast<T*>(this->alloc(sizeof(T) * std::max(count, 0), alignof(T)));
+    }
+
+    // room for one T, made with its default constructor (& lasting until the next reset())
+    template <typename T> T* make() {
+        static_assert(std::is_trivially_destructible<T>::value, "arena never calls destructors");
+        return new (this->alloc(sizeof(T), alignof(T))) T();
+    }
+
+    // frees everything that was allocated (the memory is kept for the next draw)
+    void reset();
+
+private:
+    char* fBlock;
+    size_t fSize;
+    size_t fUsed;
+    size_t fOverflow;               // bytes that didn't fit in the block since the last reset
+    std::vector<char*> fOverflowBlocks;
+    size_t fExtraSize;              // size of the newest overflow block
+    size_t fExtraUsed;              // & how much of it is taken
+
+    static const size_t kMinExtraBlock = 4096;
+
+    void* alloc(size_t bytes, size_t align);
+};
+
+#endif
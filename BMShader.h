@@ -0,0 +1,164 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef BMShader_DEFINED
+#define BMShader_DEFINED
+
+#include "include/GMatrix.h"
+#include "include/GShader.h"
+#include "include/GBitmap.h"
+#include "SampleRows.h"
+#include <cstring>
+
+/**
+ *  Shader that fills with a bitmap (made by GCreateBitmapShader), clamping to the edge
+ *  pixels outside of the bitmap, & filtering it with the quality it was made with. Its
+ *  sampling loop is inline here so the blitter can fuse it with blending instead of going
+ *  through shadeRow().
+ *
+ *  setContext() sorts the inverse matrix into one of a few kinds, & each kind samples rows
+ *  its own way. They all give exactly the pixels the general loop would.
+ */
+class BMShader : public GShader {
+    // how device pixels map to the bitmap
+    enum Kind {
+        kTranslate_Kind,    // moved by whole pixels: each row is part of a bitmap row
+        kScale_Kind,        // no rotation or skew (or filtering): each row samples a single
+                            // bitmap row
+        kGeneral_Kind,      // anything else
+    };
+
+    const GBitmap fBM;
+    const GMatrix fLocalMatrix;
+    const GFilterQuality fFilter;
+    GMatrix fInverse;
+    Kind fKind;
+    int fOffsetX, fOffsetY;     // the whole pixel move, for kTranslate_Kind
+    SampleRowProc fSampleRow;   // for kGeneral_Kind
+
+public:
+    // how many pixels shadeChunks() hands over at a time (small enough to stay in L1)
+    static const int kChunkSize = 64;
+
+    BMShader(const GBitmap& bm, const GMatrix& localInverse, GFilterQuality filter)
+        : fBM(bm), fLocalMatrix(localInverse), fFilter(filter), fKind(kGeneral_Kind),
+          fOffsetX(0), fOffsetY(0), fSampleRow(GetSampleRowProc(filter)) {}
+
+    // Return true iff all of the GPixels that may be returned by this shader will be opaque.
+    bool isOpaque();
+
+    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
+    bool setContext(const GMatrix& ctm);
+
+    /**
+     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
+     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
+     *  can hold at least [count] entries.
+     */
+    void shadeRow(int x, int y, int count, GPixel row[]) {
+        switch (fKind) {
+            case kTranslate_Kind:
+                this->translateRow(x, y, count, row);
+                break;
+            case kScale_Kind:
+                this->scaleRow(x, y, count, row);
+                break;
+            case kGeneral_Kind:
+                this->generalRow(x, y, count, row);
+                break;
+        }
+    }
+
+    /**
+     *  Same pixels as shadeRow(), but handed to sink(chunk, offset, n) kChunkSize at a time,
+     *  where chunk[0...n - 1] are the pixels for [x + offset ... x + offset + n - 1, y].
+     */
+    template <typename Sink> void shadeChunks(int x, int y, int count, Sink&& sink) {
+        GPixel chunk[kChunkSize];
+        for (int offset = 0; offset < count; offset += kChunkSize) {
+            int n = std::min(count - offset, (int)kChunkSize);
+            // when they're all in the bitmap, moved pixels don't need copying first
+            const GPixel* pixels = this->translatedPixels(x + offset, y, n);
+            if (pixels == nullptr) {
+                this->shadeRow(x + offset, y, n, chunk);
+                pixels = chunk;
+            }
+            sink(pixels, offset, n);
+        }
+    }
+
+private:
+    const GPixel* bitmapRow(int localY) const {
+        return fBM.getAddr(0, localY <= 0 ? 0 : localY >= fBM.height() ? fBM.height() - 1
+                                                                           : localY);
+    }
+
+    // any matrix (& any filter): maps each pixel center on its own (with SIMD math & gathers)
+    void generalRow(int x, int y, int count, GPixel row[]) const {
+        fSampleRow(fBM, this->rowStart(y), {fInverse[0], fInverse[3]}, x, count, row);
+    }
+
+    // just a whole pixel move: the part of a bitmap row that's under the span, with its edge
+    // pixels on either side
+    void translateRow(int x, int y, int count, GPixel row[]) const {
+        const GPixel* src = this->bitmapRow(y + fOffsetY);
+        int localX = x + fOffsetX;
+        int width = fBM.width();
+
+        int i = 0;
+        for (; i < count && localX + i < 0; i++) {
+            row[i] = src[0];
+        }
+        int inside = std::min(count, width - localX) - i;
+        if (inside > 0) {
+            memcpy(row + i, src + localX + i, inside * sizeof(GPixel));
+            i += inside;
+        }
+        for (; i < count; i++) {
+            row[i] = src[width - 1];
+        }
+    }
+
+    // the bitmap's own pixels for a span, when it's just moved & all of it is in the bitmap
+    // (null otherwise)
+    const GPixel* translatedPixels(int x, int y, int count) const {
+        if (fKind != kTranslate_Kind) return nullptr;
+        int localX = x + fOffsetX;
+        if (localX < 0 || localX + count > fBM.width()) return nullptr;
+        return this->bitmapRow(y + fOffsetY) + localX;
+    }
+
+    // no rotation or skew: the whole span is on one bitmap row, so only the x's need mapping
+    // (worked out a chunk at a time first, leaving a plain gather from the row)
+    void scaleRow(int x, int y, int count, GPixel row[]) const {
+        GPoint rowStart = this->rowStart(y);
+        const GPixel* src = fBM.getAddr(0, SampleIndex(rowStart.fY, fBM.height()));
+        int width = fBM.width();
+
+        int indices[kChunkSize];
+        for (int offset = 0; offset < count; offset += kChunkSize) {
+            int n = std::min(count - offset, (int)kChunkSize);
+            for (int i = 0; i < n; i++) {
+                indices[i] = SampleIndex(this->localPoint(rowStart, x + offset + i).fX, width);
+            }
+            for (int i = 0; i < n; i++) {
+                row[offset + i] = src[indices[i]];
+            }
+        }
+    }
+
+    // undo the transforming matrix to find the local coords of the center of pixel [0, y]
+    GPoint rowStart(int y) const {
+        return fInverse * GPoint{0.5f, y + 0.5f};
+    }
+
+    // the local coords of the center of pixel [x, y], moving right from rowStart using A & D
+    // (worked out from x, not stepped, so a pixel's sample doesn't depend on where its span
+    // starts, & spans that are split up come out the same)
+    GPoint localPoint(GPoint rowStart, int x) const {
+        return {rowStart.fX + fInverse[0] * x, rowStart.fY + fInverse[3] * x};
+    }
+};
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "BlendRows.h"
+#include "BlendFunctions.h"
+#include "CPULevel.h"
+#include <algorithm>
+
+// On x86 every SIMD version is always compiled (each one inside a target pragma, so the
+// rest of the build doesn't need -mavx2 etc), and GetCPULevel() picks one at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define BLEND_ROWS_X86
+    #include <immintrin.h>
+#endif
+
+// moves d towards s by c/255 (every channel is Div255(c * s + (255 - c) * d))
+static inline GPixel lerpPixel(GPixel s, unsigned c, GPixel d) {
+    unsigned ic = 255 - c;
+    return GPixel_PackARGB(Div255(c * GPixel_GetA(s) + ic * GPixel_GetA(d)),
+                           Div255(c * GPixel_GetR(s) + ic * GPixel_GetR(d)),
+                           Div255(c * GPixel_GetG(s) + ic * GPixel_GetG(d)),
+                           Div255(c * GPixel_GetB(s) + ic * GPixel_GetB(d)));
+}
+
+// Scalar row procs below!
+// Each one is stamped out from a per-pixel blend function, so the blend gets inlined
+// into a loop over the whole row instead of being called once per pixel
+
+namespace scalar {
+
+template <GPixel (*blend)(GPixel, GPixel)>
+static void blendRow(const GPixel src[], GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blend(src[i], dst[i]);
+    }
+}
+
+template <GPixel (*blend)(GPixel, GPixel)>
+static void blendColorRow(GPixel src, GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blend(src, dst[i]);
+    }
+}
+
+// kSrc & kClear don't read the dst, so they are just stores
+static void fillRow(GPixel src, GPixel dst[], int count) {
+    std::fill(dst, dst + count, src);
+}
+
+static void clearColorRow(GPixel src, GPixel dst[], int count) {
+    memset(dst, 0, count * sizeof(GPixel));
+}
+
+static void clearRow(const GPixel src[], GPixel dst[], int count) {
+    memset(dst, 0, count * sizeof(GPixel));
+}
+
+static void copyRow(const GPixel src[], GPixel dst[], int count) {
+    memcpy(dst, src, count * sizeof(GPixel));
+}
+
+static void lerpRow(const GPixel src[], const uint8_t coverage[], GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = lerpPixel(src[i], coverage[i], dst[i]);
+    }
+}
+
+// tables are in the same order as GBlendMode
+static const BlendRowProc gRowProcs[] = {
+    clearRow,
+    copyRow,
+    nullptr,                    // kDst: nothing changes!
+    blendRow<blendSrcOver>,
+    blendRow<blendDstOver>,
+    blendRow<blendSrcIn>,
+    blendRow<blendDstIn>,
+    blendRow<blendSrcOut>,
+    blendRow<blendDstOut>,
+    blendRow<blendSrcATop>,
+    blendRow<blendDstATop>,
+    blendRow<blendXor>,
+};
+
+static const BlendColorProc gColorProcs[] = {
+    clearColorRow,
+    fillRow,
+    nullptr,                    // kDst: nothing changes!
+    blendColorRow<blendSrcOver>,
+    blendColorRow<blendDstOver>,
+    blendColorRow<blendSrcIn>,
+    blendColorRow<blendDstIn>,
+    blendColorRow<blendSrcOut>,
+    blendColorRow<blendDstOut>,
+    blendColorRow<blendSrcATop>,
+    blendColorRow<blendDstATop>,
+    blendColorRow<blendXor>,
+};
+
+}   // namespace scalar
+
+// SSE2: 4 pixels per load, 2 pixels per 16-bit vector
+
+#if defined(BLEND_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("sse2")
+#endif
+namespace sse2 {
+
+typedef __m128i V;
+static const int N = 4;
+
+static inline V load(const GPixel* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void store(GPixel* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline V splat(GPixel p) { return _mm_set1_epi32(p); }
+
+static inline V zero() { return _mm_setzero_si128(); }
+static inline V lo(V v) { return _mm_unpacklo_epi8(v, zero()); }
+static inline V hi(V v) { return _mm_unpackhi_epi8(v, zero()); }
+static inline V pack(V l, V h) { return _mm_packus_epi16(l, h); }
+
+static inline V add(V a, V b) { return _mm_add_epi16(a, b); }
+static inline V mul(V a, V b) { return _mm_mullo_epi16(a, b); }
+static inline V inv(V v) { return _mm_sub_epi16(_mm_set1_epi16(255), v); }
+
+static inline V alpha(V v) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline V div255(V v) {
+    v = _mm_add_epi16(v, _mm_set1_epi16(128));
+    return _mm_mulhi_epu16(v, _mm_set1_epi16(257));
+}
+
+static inline V spread(const uint8_t* c) {
+    int32_t bytes;
+    memcpy(&bytes, c, sizeof(bytes));
+    V v = _mm_cvtsi32_si128(bytes);
+    v = _mm_unpacklo_epi8(v, v);
+    return _mm_unpacklo_epi16(v, v);
+}
+
+#include "BlendRows.inc"
+
+}   // namespace sse2
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+// AVX2: 8 pixels per load, 4 pixels per 16-bit vector
+// (unpack & pack both work within each 128-bit half, so the pixels stay in order)
+
+#if defined(BLEND_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+#endif
+namespace avx2 {
+
+typedef __m256i V;
+static const int N = 8;
+
+static inline V load(const GPixel* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void store(GPixel* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+static inline V splat(GPixel p) { return _mm256_set1_epi32(p); }
+
+static inline V zero() { return _mm256_setzero_si256(); }
+static inline V lo(V v) { return _mm256_unpacklo_epi8(v, zero()); }
+static inline V hi(V v) { return _mm256_unpackhi_epi8(v, zero()); }
+static inline V pack(V l, V h) { return _mm256_packus_epi16(l, h); }
+
+static inline V add(V a, V b) { return _mm256_add_epi16(a, b); }
+static inline V mul(V a, V b) { return _mm256_mullo_epi16(a, b); }
+static inline V inv(V v) { return _mm256_sub_epi16(_mm256_set1_epi16(255), v); }
+
+static inline V alpha(V v) {
+    v = _mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline V div255(V v) {
+    v = _mm256_add_epi16(v, _mm256_set1_epi16(128));
+    return _mm256_mulhi_epu16(v, _mm256_set1_epi16(257));
+}
+
+static inline V spread(const uint8_t* c) {
+    V v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)c));
+    return _mm256_mullo_epi32(v, _mm256_set1_epi32(0x01010101));
+}
+
+#include "BlendRows.inc"
+
+}   // namespace avx2
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+// AVX-512: 16 pixels per load, 8 pixels per 16-bit vector
+
+#if defined(BLEND_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx512f,avx512bw")
+#endif
+namespace avx512 {
+
+typedef __m512i V;
+static const int N = 16;
+
+static inline V load(const GPixel* p) { return _mm512_loadu_si512((const void*)p); }
+static inline void store(GPixel* p, V v) { _mm512_storeu_si512((void*)p, v); }
+static inline V splat(GPixel p) { return _mm512_set1_epi32(p); }
+
+static inline V zero() { return _mm512_setzero_si512(); }
+static inline V lo(V v) { return _mm512_unpacklo_epi8(v, zero()); }
+static inline V hi(V v) { return _mm512_unpackhi_epi8(v, zero()); }
+static inline V pack(V l, V h) { return _mm512_packus_epi16(l, h); }
+
+static inline V add(V a, V b) { return _mm512_add_epi16(a, b); }
+static inline V mul(V a, V b) { return _mm512_mullo_epi16(a, b); }
+static inline V inv(V v) { return _mm512_sub_epi16(_mm512_set1_epi16(255), v); }
+
+static inline V alpha(V v) {
+    v = _mm512_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm512_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline V div255(V v) {
+    v = _mm512_add_epi16(v, _mm512_set1_epi16(128));
+    return _mm512_mulhi_epu16(v, _mm512_set1_epi16(257));
+}
+
+static inline V spread(const uint8_t* c) {
+    V v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)c));
+    return _mm512_mullo_epi32(v, _mm512_set1_epi32(0x01010101));
+}
+
+#include "BlendRows.inc"
+
+}   // namespace avx512
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+// tables for the level GetCPULevel() picked
+static const BlendRowProc* rowProcs() {
+#if defined(BLEND_ROWS_X86)
+    switch (GetCPULevel()) {
+        case CPULevel::kAVX512: return avx512::gRowProcs;
+        case CPULevel::kAVX2:   return avx2::gRowProcs;
+        case CPULevel::kSSE2:   return sse2::gRowProcs;
+        case CPULevel::kScalar: break;
+    }
+#endif
+    return scalar::gRowProcs;
+}
+
+static const BlendColorProc* colorProcs() {
+#if defined(BLEND_ROWS_X86)
+    switch (GetCPULevel()) {
+        case CPULevel::kAVX512: return avx512::gColorProcs;
+        case CPULevel::kAVX2:   return avx2::gColorProcs;
+        case CPULevel::kSSE2:   return sse2::gColorProcs;
+        case CPULevel::kScalar: break;
+    }
+#endif
+    return scalar::gColorProcs;
+}
+
+BlendRowProc GetBlendRowProc(GBlendMode mode) {
+    return rowProcs()[static_cast<int>(mode)];
+}
+
+BlendColorProc GetBlendColorProc(GBlendMode mode) {
+    return colorProcs()[static_cast<int>(mode)];
+}
+
+LerpRowProc GetLerpRowProc() {
+#if defined(BLEND_ROWS_X86)
+    switch (GetCPULevel()) {
+        case CPULevel::kAVX512: return avx512::lerpRow;
+        case CPULevel::kAVX2:   return avx2::lerpRow;
+        case CPULevel::kSSE2:   return sse2::lerpRow;
+        case CPULevel::kScalar: break;
+    }
+#endif
+    return scalar::lerpRow;
+}
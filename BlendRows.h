@@ -0,0 +1,34 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef BlendRows_DEFINED
+#define BlendRows_DEFINED
+
+#include "include/GBlendMode.h"
+#include "include/GPixel.h"
+#include <cstdint>
+
+// blends a row of src pixels into a row of dst pixels: dst[i] = blend(src[i], dst[i])
+typedef void (*BlendRowProc)(const GPixel src[], GPixel dst[], int count);
+
+// blends the same src pixel into a row of dst pixels: dst[i] = blend(src, dst[i])
+typedef void (*BlendColorProc)(GPixel src, GPixel dst[], int count);
+
+/**
+ *  Look up the row procs for a blend mode (nullptr for kDst, since nothing changes).
+ *  These use the SIMD kernels for GetCPULevel(), and all of them give exactly the same
+ *  pixels as the per-pixel functions in BlendFunctions.h.
+ */
+BlendRowProc GetBlendRowProc(GBlendMode mode);
+BlendColorProc GetBlendColorProc(GBlendMode mode);
+
+// moves a row of dst pixels towards the src pixels by how much each one is covered:
+// dst[i] = Div255(coverage[i] * src[i] + (255 - coverage[i]) * dst[i])
+typedef void (*LerpRowProc)(const GPixel src[], const uint8_t coverage[], GPixel dst[],
+                            int count);
+
+// look up the lerp row proc for GetCPULevel() (also bit-exact across the levels)
+LerpRowProc GetLerpRowProc();
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "Blitter.h"
+#include <cstring>
+
+Blitter::Blitter(const GBitmap& device, const GIRect& clip, const ClipMask* mask,
+                 const GPaint& paint, GBlendMode mode, GPixel src, GPixel rowStorage[],
+                 uint8_t coverageStorage[])
+    : SpanBlitter(device.width(), clip), fDevice(device), fMask(mask),
+      fCoverageStorage(coverageStorage), fPipeline(paint, mode, src, rowStorage) {}
+
+void Blitter::blitRow(int x, int y, int count) {
+    if (y < fClip.fTop || y >= fClip.fBottom) return;
+    int left = std::max(x, fClip.fLeft);
+    int right = std::min(x + count, fClip.fRight);
+    if (left >= right) return;
+
+    if (fMask != nullptr) {
+        fPipeline.runCoverage(left, y, right - left, this->rowAddr(y) + left,
+                              fMask->row(y) + (left - fMask->bounds.fLeft));
+        return;
+    }
+    fPipeline.run(left, y, right - left, this->rowAddr(y) + left);
+}
+
+void Blitter::blitAntiRow(int x, int y, int count, const uint8_t coverage[]) {
+    if (y < fClip.fTop || y >= fClip.fBottom) return;
+    int left = std::max(x, fClip.fLeft);
+    int right = std::min(x + count, fClip.fRight);
+    if (left >= right) return;
+    coverage += left - x;
+
+    // covered by both the shape & the mask (coverage * mask / 255, rounded)
+    if (fMask != nullptr) {
+        const uint8_t* maskRow = fMask->row(y) + (left - fMask->bounds.fLeft);
+        for (int i = 0; i < right - left; i++) {
+            fCoverageStorage[i] = ((coverage[i] * maskRow[i] + 128) * 257) >> 16;
+        }
+        coverage = fCoverageStorage;
+    }
+    fPipeline.runCoverage(left, y, right - left, this->rowAddr(y) + left, coverage);
+}
+
+void Blitter::blitRect(const GIRect& r) {
+    GIRect rect = GIRect::LTRB(std::max(r.fLeft, fClip.fLeft), std::max(r.fTop, fClip.fTop),
+                               std::min(r.fRight, fClip.fRight),
+                               std::min(r.fBottom, fClip.fBottom));
+    if (fPipeline.isNoop() || rect.isEmpty()) return;
+
+    // with a solid color, rows that span the whole (tightly packed) device are really
+    // one long row, so blend them all with a single call
+    bool fullWidth = rect.fLeft == 0 && rect.fRight == fDevice.width();
+    bool packed = fDevice.rowBytes() == fDevice.width() * sizeof(GPixel);
+    if (fPipeline.isConstant() && fullWidth && packed && fMask == nullptr) {
+        fPipeline.run(0, rect.fTop, rect.width() * rect.height(), this->rowAddr(rect.fTop));
+        return;
+    }
+
+    for (int y = rect.fTop; y < rect.fBottom; y++) {
+        this->blitRow(rect.fLeft, y, rect.width());
+    }
+}
+
+void MaskBlitter::blitRow(int x, int y, int count) {
+    if (y < fClip.fTop || y >= fClip.fBottom) return;
+    int left = std::max(x, fClip.fLeft);
+    int right = std::min(x + count, fClip.fRight);
+    if (left >= right) return;
+    memset(fMask->row(y) + (left - fClip.fLeft), 255, right - left);
+}
+
+void MaskBlitter::blitAntiRow(int x, int y, int count, const uint8_t coverage[]) {
+    if (y < fClip.fTop || y >= fClip.fBottom) return;
+    int left = std::max(x, fClip.fLeft);
+    int right = std::min(x + count, fClip.fRight);
+    if (left >= right) return;
+    memcpy(fMask->row(y) + (left - fClip.fLeft), coverage + (left - x), right - left);
+}
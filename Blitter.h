@@ -0,0 +1,112 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef Blitter_DEFINED
+#define Blitter_DEFINED
+
+#include "include/GBitmap.h"
+#include "include/GPaint.h"
+#include "include/GRect.h"
+#include "RasterPipeline.h"
+#include <vector>
+
+/**
+ *  A clip that isn't just a rect: how much of each pixel in bounds (0...255) is inside it.
+ *  Pixels outside bounds are all the way outside.
+ */
+struct ClipMask {
+    GIRect bounds;
+    std::vector<uint8_t> coverage;      // bounds.width() per row, top to bottom
+
+    const uint8_t* row(int y) const {
+        return coverage.data() + (y - bounds.fTop) * bounds.width();
+    }
+    uint8_t* row(int y) {
+        return coverage.data() + (y - bounds.fTop) * bounds.width();
+    }
+};
+
+/**
+ *  Where the rasterizers send their spans. width() is the device's width (spans' x are device
+ *  x's), & only pixels inside clip() need to be sent.
+ */
+class SpanBlitter {
+public:
+    virtual ~SpanBlitter() {}
+
+    // the pixels [x ... x + count - 1] on row y are inside the shape
+    virtual void blitRow(int x, int y, int count) = 0;
+
+    // the pixels [x ... x + count - 1] on row y are each covered by coverage[i] / 255
+    virtual void blitAntiRow(int x, int y, int count, const uint8_t coverage[]) = 0;
+
+    int width() const { return fWidth; }
+    const GIRect& clip() const { return fClip; }
+
+protected:
+    SpanBlitter(int width, const GIRect& clip) : fWidth(width), fClip(clip) {}
+
+    const int fWidth;
+    const GIRect fClip;
+};
+
+/**
+ *  Draws horizontal spans of pixels into the device with a paint. The raster pipeline for
+ *  the paint's color or shader & blend mode is picked once when the blitter is made, so each
+ *  span is just a tight loop over a contiguous row of the device.
+ *
+ *  Only the pixels inside the clip are ever changed; spans (& rects) are cut down to it. With
+ *  a mask, each pixel is also only changed by how much the mask covers it.
+ */
+class Blitter final : public SpanBlitter {
+public:
+    /**
+     *  src is the paint's color as a pixel (mode may differ from the paint's, once the canvas
+     *  has optimized it). rowStorage must hold at least clip.width() pixels; it is where a
+     *  shader that can't be fused writes each row before it is blended.
+     *
+     *  mask may be null. If it isn't, it must cover clip, & coverageStorage must hold at
+     *  least clip.width() values (for mixing the mask with anti-aliased rows).
+     */
+    Blitter(const GBitmap& device, const GIRect& clip, const ClipMask* mask,
+            const GPaint& paint, GBlendMode mode, GPixel src, GPixel rowStorage[],
+            uint8_t coverageStorage[]);
+
+    // blend the pixels [x ... x + count - 1] on row y
+    void blitRow(int x, int y, int count) override;
+
+    // blend the pixels [x ... x + count - 1] on row y, each by how much it's covered (0...255)
+    void blitAntiRow(int x, int y, int count, const uint8_t coverage[]) override;
+
+    // blend every pixel inside rect
+    void blitRect(const GIRect& rect);
+
+private:
+    const GBitmap& fDevice;
+    const ClipMask* fMask;
+    uint8_t* fCoverageStorage;
+    RasterPipeline fPipeline;
+
+    // returns address of the first pixel in row y
+    GPixel* rowAddr(int y) const {
+        return (GPixel*)((char*)fDevice.pixels() + y * fDevice.rowBytes());
+    }
+};
+
+/**
+ *  Writes the coverage of the spans it's sent into a clip mask (which should start out all
+ *  0s), instead of drawing them. Its clip is the mask's bounds.
+ */
+class MaskBlitter final : public SpanBlitter {
+public:
+    MaskBlitter(int width, ClipMask* mask) : SpanBlitter(width, mask->bounds), fMask(mask) {}
+
+    void blitRow(int x, int y, int count) override;
+    void blitAntiRow(int x, int y, int count, const uint8_t coverage[]) override;
+
+private:
+    ClipMask* fMask;
+};
+
+#endif
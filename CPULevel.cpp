@@ -0,0 +1,69 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "include/GCanvas.h"
+#include "CPULevel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define CPU_LEVEL_X86
+#endif
+
+static const char* gLevelNames[] = { "scalar", "sse2", "avx2", "avx512" };
+
+// best level this CPU can run (the builtins also check that the OS saves the wide registers)
+static CPULevel detectCPULevel() {
+#if defined(CPU_LEVEL_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return CPULevel::kAVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) return CPULevel::kAVX2;
+    if (__builtin_cpu_supports("sse2")) return CPULevel::kSSE2;
+#endif
+    return CPULevel::kScalar;
+}
+
+// looks up a level by name, returning false if there isn't one
+static bool levelFromName(const char name[], CPULevel* level) {
+    for (int i = 0; i < GARRAY_COUNT(gLevelNames); i++) {
+        if (strcmp(name, gLevelNames[i]) == 0) {
+            *level = static_cast<CPULevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// the level in use, found the first time anyone asks for it
+static CPULevel& currentLevel() {
+    static CPULevel level = []() {
+        CPULevel best = detectCPULevel();
+        CPULevel forced;
+        const char* env = getenv("G_CPU_LEVEL");
+        if (env != nullptr && levelFromName(env, &forced) && forced <= best) {
+            return forced;
+        }
+        return best;
+    }();
+    return level;
+}
+
+CPULevel GetCPULevel() {
+    return currentLevel();
+}
+
+const char* CPULevelName(CPULevel level) {
+    return gLevelNames[static_cast<int>(level)];
+}
+
+const char* GGetCPULevel() {
+    return CPULevelName(GetCPULevel());
+}
+
+bool GSetCPULevel(const char name[]) {
+    CPULevel level;
+    if (!levelFromName(name, &level) || level > detectCPULevel()) return false;
+    currentLevel() = level;
+    return true;
+}
@@ -0,0 +1,26 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef CPULevel_DEFINED
+#define CPULevel_DEFINED
+
+// instruction sets we compile raster kernels for, from slowest to fastest
+enum class CPULevel {
+    kScalar,
+    kSSE2,
+    kAVX2,
+    kAVX512,
+};
+
+/**
+ *  Returns the level the raster kernels should use. The first call checks the CPU (and the
+ *  G_CPU_LEVEL environment variable, which can force a lower level for testing), and every
+ *  call after that just returns the saved answer.
+ */
+CPULevel GetCPULevel();
+
+// name of the level, e.g. "avx2"
+const char* CPULevelName(CPULevel level);
+
+#endif
@@ -8,6 +8,7 @@
 #include "include/GMath.h"
 #include "include/GPoint.h"
 #include <algorithm>
+#include <cstdint>
 
 class Edge {
 public:
@@ -22,6 +23,14 @@ public:
     float m;
     float b;
 
+    // +1 if the edge goes down (p1 above p2), -1 if it goes up
+    int winding;
+
+    // x at the center of the current row & how much it changes per row, in 16.16 fixed point
+    // (so stepping down the rows is just an int add, see startStepping())
+    int32_t fixedX;
+    int32_t fixedDX;
+
     // constructor
     Edge(GPoint s = {0, 0}, GPoint t = {0, 0}) {
         p1 = s;
@@ -34,6 +43,31 @@ public:
         m = (p2.fX - p1.fX) / (p2.fY - p1.fY);
         // b = x - my
         b = p1.fX - m * p1.fY;
+
+        winding = p1.fY <= p2.fY ? 1 : -1;
+        fixedX = 0;
+        fixedDX = 0;
+    }
+
+    // set up fixedX & fixedDX so that currX() is the edge's (rounded) x in row y
+    void startStepping(int y) {
+        fixedX = toFixed(xIntersect(y + 0.5f));
+        fixedDX = toFixed(m);
+    }
+
+    // rounds the fixed point x to the nearest pixel boundary
+    int currX() const {
+        return (fixedX + (1 << 15)) >> 16;
+    }
+
+    // move x down to the next row
+    void step() {
+        fixedX += fixedDX;
+    }
+
+    // move x down by rows at once (exactly the same as calling step() that many times)
+    void step(int rows) {
+        fixedX = (int32_t)((uint32_t)fixedX + (uint32_t)fixedDX * (uint32_t)rows);
     }
 
     float xIntersect(float y) {
@@ -49,6 +83,14 @@ public:
         return y;
     }
 
+private:
+    // pins to what 16.16 can hold (only edges that are flat enough to be less than a row
+    // tall can get near that, & they never step)
+    static int32_t toFixed(float x) {
+        x = std::max(-32767.0f, std::min(32767.0f, x));
+        return (int32_t)floorf(x * 65536 + 0.5f);
+    }
+
 };
 
 #endif
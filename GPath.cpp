@@ -0,0 +1,155 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "include/GPath.h"
+#include <cmath>
+
+// no curve is ever split into more lines than this, however big it gets
+static const int kMaxCurveLines = 1024;
+
+GPath& GPath::close() {
+    // find where the current contour started
+    int pt = (int)fPts.size();
+    for (int i = (int)fVbs.size() - 1; i >= 0; i--) {
+        pt -= PointCount(fVbs[i]);
+        if (fVbs[i] == kMove) {
+            if (i < (int)fVbs.size() - 1) this->lineTo(fPts[pt]);
+            break;
+        }
+    }
+    return *this;
+}
+
+GRect GPath::bounds() const {
+    if (fPts.empty()) return GRect::LTRB(0, 0, 0, 0);
+
+    float l = fPts[0].fX, t = fPts[0].fY, r = l, b = t;
+    for (const GPoint& p : fPts) {
+        l = std::min(l, p.fX);
+        t = std::min(t, p.fY);
+        r = std::max(r, p.fX);
+        b = std::max(b, p.fY);
+    }
+    return GRect::LTRB(l, t, r, b);
+}
+
+void GPath::transform(const GMatrix& matrix) {
+    matrix.mapPoints(fPts.data(), fPts.data(), (int)fPts.size());
+}
+
+bool GPath::hasCurves() const {
+    for (Verb verb : fVbs) {
+        if (verb == kQuad || verb == kCubic) return true;
+    }
+    return false;
+}
+
+/**
+ *  The number of lines a curve needs, given how far it bends (the biggest second difference
+ *  of its points, d) & how much bending its second derivative gets from that (k). Splitting
+ *  the curve evenly into n lines keeps them within |B''| / (8 n^2) of it, & |B''| <= k * d.
+ */
+static int CurveLines(float d, float k, float tolerance) {
+    float lines = ceilf(sqrtf(k * d / (8 * tolerance)));
+    if (!(lines >= 1)) return 1;
+    return (int)std::min(lines, (float)kMaxCurveLines);
+}
+
+GPath GPath::flattened(float tolerance) const {
+    GPath path;
+    path.fFillType = fFillType;
+    path.fPts.reserve(fPts.size());
+    path.fVbs.reserve(fVbs.size());
+
+    int pt = 0;
+    for (Verb verb : fVbs) {
+        const GPoint* p = &fPts[pt];
+        switch (verb) {
+            case kMove:
+                path.moveTo(p[0]);
+                break;
+            case kLine:
+                path.lineTo(p[0]);
+                break;
+            case kQuad: {
+                // from the last point p[-1], through control point p[0], to p[1]
+                GPoint a = p[-1], b = p[0], c = p[1];
+                int lines = CurveLines((a - b * 2 + c).length(), 2, tolerance);
+                for (int i = 1; i < lines; i++) {
+                    float t = (float)i / lines, u = 1 - t;
+                    path.lineTo(a * (u * u) + b * (2 * u * t) + c * (t * t));
+                }
+                path.lineTo(c);
+                break;
+            }
+            case kCubic: {
+                GPoint a = p[-1], b = p[0], c = p[1], d = p[2];
+                float bend = std::max((a - b * 2 + c).length(), (b - c * 2 + d).length());
+                int lines = CurveLines(bend, 6, tolerance);
+                for (int i = 1; i < lines; i++) {
+                    float t = (float)i / lines, u = 1 - t;
+                    path.lineTo(a * (u * u * u) + b * (3 * u * u * t) + c * (3 * u * t * t) +
+                                d * (t * t * t));
+                }
+                path.lineTo(d);
+                break;
+            }
+            case kDone:
+                break;
+        }
+        pt += PointCount(verb);
+    }
+    return path;
+}
+
+GPath::Verb GPath::Edger::next(GPoint pts[]) {
+    const int vbCount = (int)fPath.fVbs.size();
+    while (fVbIndex < vbCount) {
+        Verb verb = fPath.fVbs[fVbIndex];
+        if (verb == kMove) {
+            // close the contour before this one first
+            if (fInContour && fLast != fContourStart) {
+                pts[0] = fLast;
+                pts[1] = fContourStart;
+                fLast = fContourStart;
+                return kLine;
+            }
+            fContourStart = fLast = fPath.fPts[fPtIndex++];
+            fVbIndex++;
+            fInContour = true;
+            continue;
+        }
+
+        // kLine (or the line to the end of a curve)
+        fPtIndex += PointCount(verb);
+        pts[0] = fLast;
+        pts[1] = fLast = fPath.fPts[fPtIndex - 1];
+        fVbIndex++;
+        return kLine;
+    }
+
+    // close the last contour
+    if (fInContour && fLast != fContourStart) {
+        pts[0] = fLast;
+        pts[1] = fContourStart;
+        fLast = fContourStart;
+        fInContour = false;
+        return kLine;
+    }
+    return kDone;
+}
+
+int GPath::Contourer::next(const GPoint** pts) {
+    const int vbCount = (int)fPath.fVbs.size();
+    if (fVbIndex >= vbCount) return 0;
+
+    // a contour is its move & all the lines & curves after it
+    int start = fPtIndex;
+    fPtIndex += PointCount(fPath.fVbs[fVbIndex++]);
+    while (fVbIndex < vbCount && fPath.fVbs[fVbIndex] != kMove) {
+        fPtIndex += PointCount(fPath.fVbs[fVbIndex++]);
+    }
+    *pts = fPath.fPts.data() + start;
+    return fPtIndex - start;
+}
@@ -7,12 +7,19 @@
 #include "include/GColor.h"
 #include "include/GBitmap.h"
 #include "include/GShader.h"
+#include "include/GPath.h"
 
-#include "BlendFunctions.h"
+#include "MyCanvas.h"
+#include "Arena.h"
+#include "Blitter.h"
 #include "Edge.h"
+#include "Rasterizer.h"
+#include "Stroker.h"
 #include <iostream>
 #include <algorithm>
+#include <memory>
 #include <stack>
+#include <vector>
 
 // Helper functions below!
 
@@ -27,98 +34,10 @@ static GPixel ColorToPixel(const GColor& color) {
     return outPixel;
 }
 
-// Returns GPixel address in mem, given the xy coords
-static GPixel* get_pixel_addr(const GBitmap& bitmap, int x, int y) {
-    GPixel* startingAddr = bitmap.pixels();
-    char* row = (char*)startingAddr + y * bitmap.rowBytes();
-    return (GPixel*)row + x;
-}
-
-// Clip edges of convex polygon, making new array outEdgeArray
-// Return the count of used elements of the array
-static int clipEdges(Edge edgeArray[], int count, int fWidth, int fHeight, Edge* outEdgeArray) {
-    
-    int trackEdgeArray = 0;
-
-    // loop thru array to clip each edge
-    for (int i = 0; i < count; i++) {
-        Edge currEdge = edgeArray[i];
-        GPoint p1 = currEdge.p1;
-        GPoint p2 = currEdge.p2;
-
-        // check vertical clipping first
-        if (p1.fY > p2.fY) std::swap(p1, p2);   // ensures p1 is the higher point
-        if (p2.fY <= 0 || p1.fY >= fHeight) continue;   // discard edge if completely too high or low
-        // clip top
-        if (p1.fY < 0) {
-            p1 = {currEdge.xIntersect(0), 0};
-        }
-        // clip bottom
-        if (p2.fY > fHeight) {
-            p2 = {currEdge.xIntersect(fHeight), float(fHeight)};
-        }
-
-        // check horizontal clipping
-        bool extraEdge = false;
-        Edge sideEdge;
-        if (p1.fX > p2.fX) std::swap(p1, p2);   // ensures p1 is the leftmost point
-        if (p2.fX <= 0) {       // if complpetely too left, just make projection
-            p1 = {0, p1.fY};
-            p2 = {0, p2.fY};
-        }
-        else if (p1.fX >= fWidth) {    // if completely too right, make projection
-            p1 = {float(fWidth), p1.fY};
-            p2 = {float(fWidth), p2.fY};
-        }
-        // clip left
-        if (p1.fX < 0) {
-            extraEdge = true;
-            // replace p1 with intersection pt at left side
-            GPoint sidePoint = {0, p1.fY};
-            p1 = {0, currEdge.yIntersect(0)};
-            if (p1.fY < 0) p1.fY = 0;
-            if (p1.fY >= fWidth) p1.fY = float(fWidth);
-            // & add edge going from intersection to y-value of p1
-            sideEdge = {p1, sidePoint};
-        }
-        // clip right
-        if (p2.fX > fWidth) {
-            extraEdge = true;
-            // replace p2 with intersection pt at right side
-            GPoint sidePoint = {float(fWidth), p2.fY};
-            p2 = {float(fWidth), currEdge.yIntersect(fWidth)};
-            if (p2.fY < 0) p2.fY = 0;
-            if (p2.fY >= fWidth) p2.fY = float(fWidth);
-            // & add edge going from intersection to y-value of p2
-            sideEdge = {p2, sidePoint};
-        }
-
-        // put clipped edge into the vector
-        Edge newEdge = Edge(p1, p2);
-        // discard new edge if it is horizontal
-        if (newEdge.yTop == newEdge.yBottom) continue;
-        outEdgeArray[trackEdgeArray] = newEdge;
-        trackEdgeArray++;
-        // if clipped horizontally, add in extra edge
-        if (extraEdge) {
-            outEdgeArray[trackEdgeArray] = sideEdge;
-            trackEdgeArray++;
-        }
-    }
-
-    // return the last filled element of the array
-    return trackEdgeArray;
-}
-
-// comparator to sort Edges
-bool compareEdges(Edge& e1, Edge& e2) {
-    if (e1.yTop == e2.yTop) return (e1.xLeft < e2.xLeft);
-    return (e1.yTop < e2.yTop);
-}
-
 GBlendMode optimizeMode(GShader* shaderPtr, GBlendMode mode, float alpha) {
     // optimize when alpha is 0
-    if (shaderPtr==nullptr && alpha == 0) {
+    // (the paint alpha scales a shader too, so it doesn't matter if there is one)
+    if (alpha == 0) {
         if (mode == GBlendMode::kSrcIn || mode == GBlendMode::kDstIn ||
             mode == GBlendMode::kSrcOut || mode == GBlendMode::kDstATop) {
                 mode = GBlendMode::kClear;
@@ -135,8 +54,8 @@ GBlendMode optimizeMode(GShader* shaderPtr, GBlendMode mode, float alpha) {
         if (mode == GBlendMode::kXor) mode = GBlendMode::kSrcOut;
     }
 
-    // optimize when shader is opaque
-    if (shaderPtr!=nullptr && shaderPtr->isOpaque()) {
+    // optimize when shader is opaque (& the paint alpha doesn't make it see-through)
+    if (shaderPtr!=nullptr && shaderPtr->isOpaque() && alpha == 1) {
         if (mode == GBlendMode::kSrcOver) mode = GBlendMode::kSrc;
         if (mode == GBlendMode::kDstIn) mode = GBlendMode::kDst;
         if (mode == GBlendMode::kDstOut) mode = GBlendMode::kClear;
@@ -148,6 +67,25 @@ GBlendMode optimizeMode(GShader* shaderPtr, GBlendMode mode, float alpha) {
     return mode;
 }
 
+// when every dst pixel is opaque (Da = 255), some modes simplify to cheaper ones
+// with exactly the same results
+GBlendMode optimizeModeForOpaqueDst(GBlendMode mode) {
+    if (mode == GBlendMode::kDstOver) mode = GBlendMode::kDst;
+    if (mode == GBlendMode::kSrcIn) mode = GBlendMode::kSrc;
+    if (mode == GBlendMode::kSrcOut) mode = GBlendMode::kClear;
+    if (mode == GBlendMode::kSrcATop) mode = GBlendMode::kSrcOver;
+    if (mode == GBlendMode::kDstATop) mode = GBlendMode::kDstIn;
+    if (mode == GBlendMode::kXor) mode = GBlendMode::kDstOut;
+    return mode;
+}
+
+// true if every src pixel the paint makes will have alpha 255
+static bool isSrcOpaque(const GPaint& paint) {
+    GShader* shaderPtr = paint.getShader();
+    if (shaderPtr != nullptr) return shaderPtr->isOpaque() && paint.getAlpha() == 1;
+    return paint.getAlpha() == 1;
+}
+
 
 // prints Edge array for debugging
 void printEdgeArray(Edge* edgesArrayPtr, int count) {
@@ -169,11 +107,29 @@ void printPoints(GPoint pts[], int count) {
 
 class MyCanvas : public GCanvas {
 public:
-    MyCanvas(const GBitmap& device) : fDevice(device) {}
+    MyCanvas(const GBitmap& device)
+        : MyCanvas(device, GIRect::WH(device.width(), device.height()), true) {}
+
+    /**
+     *  A canvas that only draws the pixels inside clip (the same pixels, with the same values,
+     *  as a canvas for the whole device would). If setsShaderContext is false it never calls
+     *  setContext() on shaders, so the caller has to, with the CTM, before each draw.
+     */
+    MyCanvas(const GBitmap& device, const GIRect& clip, bool setsShaderContext)
+        : fDevice(device), fClip(clip), fSetsShaderContext(setsShaderContext),
+          fShadeRow(clip.width()), fMaskRow(clip.width()),
+          fOpaqueRows(device.height(), false) {}
+
+    // the state that save() & restore() keep: the CTM & the clip
+    struct State {
+        GMatrix ctm;
+        GIRect clip;                            // the pixels draws can change
+        std::shared_ptr<const ClipMask> mask;   // & how much, if the clip isn't just a rect
+    };
 
-    // stores current transformation matrices (CTMs) in a stack
-    std::stack<GMatrix> mxStack;
-    // the CTM can then be referenced via mxStack.top()
+    // stores the current state (CTM & clip) in a stack
+    std::stack<State> mxStack;
+    // the state can then be referenced via state()
 
     /**
      *  Save off a copy of the canvas state (CTM), to be later used if the balancing call to
@@ -187,12 +143,8 @@ public:
      *  restore();              // now the CTM is as it was when the 1st save() call was made
      */
     void save() {
-        if (mxStack.empty()) {
-            GMatrix id = GMatrix();
-            mxStack.push(id);
-        }
-        GMatrix mx = GMatrix(mxStack.top());
-        mxStack.push(mx);
+        State st = state();
+        mxStack.push(st);
     }
 
     /**
@@ -210,154 +162,106 @@ public:
      *  CTM' = CTM * matrix
      */
     void concat(const GMatrix& matrix) {
-        if (mxStack.empty()) {
-            GMatrix id = GMatrix();
-            mxStack.push(id);
-        }
-        GMatrix newMatrix = GMatrix::Concat(mxStack.top(), matrix);
-        mxStack.pop();
-        mxStack.push(newMatrix);
+        State& st = state();
+        st.ctm = GMatrix::Concat(st.ctm, matrix);
     }
 
     /**
-     *  Template to loop thru rows & replace each pixel with a new blended pixel
-     *  with no shader
-     *  For filling entire device screen, rectPtr is nullptr
+     *  Intersects the clip with the rectangle (mapped by the CTM). Only pixels inside the clip
+     *  are changed by later draws.
      */
-    template <typename Method>
-    void drawRows(GPixel src, GIRect* rectPtr, Method bl) {
-        // if no rect, fill whole device screen
-        if (rectPtr == nullptr) {
-            int x = fDevice.width();
-            int y = fDevice.height();
-            int numPixels = x * y;
-            int pixelCount = 0;
-            GPixel* dstPtr = fDevice.pixels();
-            while (pixelCount < numPixels) {
-                GPixel blendedPixel = bl(src, *dstPtr);
-                *dstPtr = blendedPixel;
-                dstPtr++;
-                pixelCount++;
-            }
+    void clipRect(const GRect& rect) {
+        State& st = state();
+        GPoint cornerPts[4] = {{rect.fLeft, rect.fTop}, {rect.fRight, rect.fTop},
+                               {rect.fRight, rect.fBottom}, {rect.fLeft, rect.fBottom}};
+        GPoint newCornerPts[4];
+        st.ctm.mapPoints(newCornerPts, cornerPts, 4);
+
+        // if it's still axis-aligned, it just cuts down the clip's bounds
+        if (st.ctm[1] == 0 && st.ctm[3] == 0) {
+            st.clip = intersect(st.clip, pointBounds(newCornerPts, 4).round());
             return;
         }
 
-        GIRect rect = *rectPtr;
-        // otherwise, loop thru rows of rectangle
-        for (int y = rect.fTop; y < rect.fBottom; y++) {
-            for (int x = rect.fLeft; x < rect.fRight; x++) {
-                GPixel* dstPtr = get_pixel_addr(fDevice, x, y);
-                GPixel blendedPixel = bl(src, *dstPtr);
-                *dstPtr = blendedPixel;
-            }
-        }
+        // otherwise it's clipped to like any other path
+        GPath path;
+        path.moveTo(cornerPts[0]).lineTo(cornerPts[1]).lineTo(cornerPts[2]).lineTo(cornerPts[3]);
+        clipPath(path, false);
     }
 
     /**
-     *  Template to loop thru rows & replace each pixel with a new blended pixel
-     *  and using the specified shader
-     *  For filling entire device screen, rectPtr is nullptr
+     *  Intersects the clip with the path (mapped by the CTM), by filling it into a mask of
+     *  how much of each pixel is inside.
      */
-    template <typename Method>
-    void drawRowsShader(GShader* shaderPtr, GIRect* rectPtr, Method bl) {
-        GIRect rect;
-        // if no rect, make rect of full device screen
-        if (rectPtr == nullptr) {
-            rect = {0, 0, fDevice.width(), fDevice.height()};
+    void clipPath(const GPath& path, bool antiAlias) {
+        State& st = state();
+
+        // the mask only needs to cover the pixels the path can touch that are still in the clip
+        // (the path isn't copied to map it, so this is the bounds of its mapped bounds)
+        GRect pathBounds = path.bounds();
+        GPoint corners[4] = {{pathBounds.fLeft, pathBounds.fTop},
+                             {pathBounds.fRight, pathBounds.fTop},
+                             {pathBounds.fRight, pathBounds.fBottom},
+                             {pathBounds.fLeft, pathBounds.fBottom}};
+        st.ctm.mapPoints(corners, 4);
+        GRect bounds = pointBounds(corners, 4);
+        GIRect maskBounds = intersect(st.clip, GIRect::LTRB(GFloorToInt(bounds.fLeft),
+                                                            GFloorToInt(bounds.fTop),
+                                                            GCeilToInt(bounds.fRight),
+                                                            GCeilToInt(bounds.fBottom)));
+        if (maskBounds.isEmpty()) {
+            st.clip = maskBounds;
+            st.mask = nullptr;
+            return;
         }
-        else rect = *rectPtr;
-
-        int startX = rect.fLeft;
-        int count = rect.fRight - startX;
-        GPixel src[count];
-
-        // loop thru rows of rectangle
-        for (int y = rect.fTop; y < rect.fBottom; y++) {
-            shaderPtr->shadeRow(startX, y, count, src);
-            for (int x = rect.fLeft; x < rect.fRight; x++) {
-                GPixel* dstPtr = get_pixel_addr(fDevice, x, y);
-                GPixel blendedPixel = bl(src[x - startX], *dstPtr);
-                *dstPtr = blendedPixel;
+
+        std::shared_ptr<ClipMask> mask = std::make_shared<ClipMask>();
+        mask->bounds = maskBounds;
+        mask->coverage.assign(maskBounds.width() * maskBounds.height(), 0);
+        int edgeCount;
+        Edge* edges = pathEdges(path, st.ctm, bounds, antiAlias, &edgeCount);
+        MaskBlitter blitter(fDevice.width(), mask.get());
+        FillEdges(edges, edgeCount, path.getFillType(), antiAlias, blitter, fArena);
+
+        // pixels have to be inside the clip it had before too
+        if (st.mask != nullptr) {
+            for (int y = maskBounds.fTop; y < maskBounds.fBottom; y++) {
+                uint8_t* row = mask->row(y);
+                const uint8_t* oldRow = st.mask->row(y) +
+                                        (maskBounds.fLeft - st.mask->bounds.fLeft);
+                for (int i = 0; i < maskBounds.width(); i++) {
+                    row[i] = ((row[i] * oldRow[i] + 128) * 257) >> 16;
+                }
             }
         }
+
+        st.clip = maskBounds;
+        st.mask = mask;
+    }
+
+    // draws only ever change the pixels in the clip (& can't say which ones with a mask)
+    bool getDeviceState(GMatrix* ctm, GIRect* bounds) const {
+        if (mxStack.empty()) {
+            *ctm = GMatrix();
+            *bounds = fClip;
+            return true;
+        }
+        *ctm = mxStack.top().ctm;
+        *bounds = mxStack.top().clip;
+        return mxStack.top().mask == nullptr;
     }
 
     /**
-     *  Helper function that handles the switch case for choosing a blend mode
-     *  & then calls drawRows to draw
+     *  Helper function that makes a blitter for the paint & (optimized) blend mode
+     *  & then uses it to draw the rect (or the whole device when rectPtr is nullptr)
      */
-    void blendAndDraw(GBlendMode mode, GShader* shader, GPixel src, GIRect* rectPtr) {
-        switch (mode) {
-            case GBlendMode::kClear:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendClear);
-                    else drawRowsShader(shader, rectPtr, blendClear);
-                }
-                break;
-            case GBlendMode::kSrc:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendSrc);
-                    else drawRowsShader(shader, rectPtr, blendSrc);
-                }
-                break;
-            case GBlendMode::kDst:
-                // nothing changes!
-                break;
-            case GBlendMode::kSrcOver:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendSrcOver);
-                    else drawRowsShader(shader, rectPtr, blendSrcOver);
-                }
-                break;
-            case GBlendMode::kDstOver:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendDstOver);
-                    else drawRowsShader(shader, rectPtr, blendDstOver);
-                }
-                break;
-            case GBlendMode::kSrcIn:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendSrcIn);
-                    else drawRowsShader(shader, rectPtr, blendSrcIn);
-                }
-                break;
-            case GBlendMode::kDstIn:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendDstIn);
-                    else drawRowsShader(shader, rectPtr, blendDstIn);
-                }
-                break;
-            case GBlendMode::kSrcOut:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendSrcOut);
-                    else drawRowsShader(shader, rectPtr, blendSrcOut);
-                }
-                break;
-            case GBlendMode::kDstOut:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendDstOut);
-                    else drawRowsShader(shader, rectPtr, blendDstOut);
-                }
-                break;
-            case GBlendMode::kSrcATop:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendSrcATop);
-                    else drawRowsShader(shader, rectPtr, blendSrcATop);
-                }
-                break;
-            case GBlendMode::kDstATop:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendDstATop);
-                    else drawRowsShader(shader, rectPtr, blendDstATop);
-                }
-                break;
-            case GBlendMode::kXor:
-                {
-                    if (shader == nullptr) drawRows(src, rectPtr, blendXor);
-                    else drawRowsShader(shader, rectPtr, blendXor);
-                }
-                break;
-        }
+    void blendAndDraw(const GPaint& paint, GBlendMode mode, GPixel src, GIRect* rectPtr) {
+        GIRect rect = {0, 0, fDevice.width(), fDevice.height()};
+        if (rectPtr != nullptr) rect = *rectPtr;
+
+        Blitter blitter(fDevice, state().clip, state().mask.get(), paint, mode, src,
+                        fShadeRow.data(), fMaskRow.data());
+        blitter.blitRect(rect);
     }
 
     /**
@@ -365,32 +269,28 @@ public:
      */
     void drawPaint(const GPaint& paint) {
         // set up CTM
-        if (mxStack.empty()) {
-            GMatrix id = GMatrix();
-            mxStack.push(id);
-        }
-        GMatrix CTM = mxStack.top();
+        GMatrix CTM = state().ctm;
 
         // if there is a shader, set context
         GShader* shaderPtr = paint.getShader();
-        if (shaderPtr != nullptr) {
-            bool sh = shaderPtr->setContext(CTM);
-            if (!sh) return;
-        }
+        if (!setShaderContext(shaderPtr, CTM)) return;
 
         // establish pixel & blend mode to paint with
         GPixel newPixel = ColorToPixel(paint.getColor());
         GBlendMode mode = paint.getBlendMode();
 
         // optimize based on modes & opacity
-        if (shaderPtr==nullptr && paint.getAlpha() == 0) {
+        if (paint.getAlpha() == 0) {
             if (mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
                 mode == GBlendMode::kDstOut || mode == GBlendMode::kSrcATop) return;
         }
         mode = optimizeMode(shaderPtr, mode, paint.getAlpha());
+        const GIRect& clip = state().clip;
+        if (rowsAreOpaque(clip.fTop, clip.fBottom)) mode = optimizeModeForOpaqueDst(mode);
 
         // loop thru canvas based on which blend mode is being used
-        blendAndDraw(mode, shaderPtr, newPixel, nullptr);
+        blendAndDraw(paint, mode, newPixel, nullptr);
+        updateOpaqueRows(clip.fTop, clip.fBottom, coversRows(clip), mode, isSrcOpaque(paint));
 
     }
     
@@ -401,19 +301,14 @@ public:
      *      e.g. contained == center > min_edge && center <= max_edge
      */
     void drawRect(const GRect& rect, const GPaint& paint) {
-        // set up CTM
-        if (mxStack.empty()) {
-            GMatrix id = GMatrix();
-            mxStack.push(id);
+        // strokes are drawn as paths
+        if (paint.isStroke()) {
+            drawPath(RectOutline(rect), paint);
+            return;
         }
-        GMatrix CTM = mxStack.top();
 
-        // if there is a shader, set context
-        GShader* shaderPtr = paint.getShader();
-        if (shaderPtr != nullptr) {
-            bool sh = shaderPtr->setContext(CTM);
-            if (!sh) return;
-        }
+        // set up CTM
+        GMatrix CTM = state().ctm;
 
         // map points based on CTM
         GPoint cornerPts[4] = {{rect.fLeft, rect.fTop}, {rect.fRight, rect.fTop},
@@ -421,9 +316,21 @@ public:
         GPoint newCornerPts[4];
         CTM.mapPoints(newCornerPts, cornerPts, 4);
 
+        // nothing to do if it's all outside the clip
+        if (!touchesClip(pointBounds(newCornerPts, 4))) return;
+
+        // if there is a shader, set context
+        GShader* shaderPtr = paint.getShader();
+        if (!setShaderContext(shaderPtr, CTM)) return;
+
         // if the rectangle has been rotated, treat it as a polygon instead
+        // (same if it's anti-aliased & its sides aren't on pixel boundaries)
         bool isRotated = newCornerPts[0].fY != newCornerPts[1].fY;
-        if (isRotated) {
+        bool isFractional = false;
+        for (const GPoint& p : newCornerPts) {
+            if (p.fX != floorf(p.fX) || p.fY != floorf(p.fY)) isFractional = true;
+        }
+        if (isRotated || (paint.isAntiAlias() && isFractional)) {
             drawConvexPolygon(cornerPts, 4, paint);
             return;
         }
@@ -439,26 +346,26 @@ public:
         GPixel srcPixel = ColorToPixel(paint.getColor());
         GBlendMode mode = paint.getBlendMode();
 
-        // clip areas that are outside canvas
-        int canvasX = fDevice.width();
-        int canvasY = fDevice.height();
-        if (roundedRect.fLeft < 0) roundedRect.fLeft = 0;
-        if (roundedRect.fTop < 0) roundedRect.fTop = 0;
-        if (roundedRect.fRight > canvasX) roundedRect.fRight = canvasX;
-        if (roundedRect.fBottom > canvasY) roundedRect.fBottom = canvasY;
+        // clip areas that are outside the clip
+        roundedRect = intersect(roundedRect, state().clip);
 
         // check if rect shouldn't be drawn at all
         if (roundedRect.fLeft >= roundedRect.fRight) return;
         if (roundedRect.fTop >= roundedRect.fBottom) return;
         
         // optimize based on modes & opacity
-        if (shaderPtr==nullptr && paint.getAlpha() == 0) {
+        if (paint.getAlpha() == 0) {
             if (mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
                 mode == GBlendMode::kDstOut || mode == GBlendMode::kSrcATop) return;
         }
         mode = optimizeMode(shaderPtr, mode, paint.getAlpha());
+        if (rowsAreOpaque(roundedRect.fTop, roundedRect.fBottom)) {
+            mode = optimizeModeForOpaqueDst(mode);
+        }
 
-        blendAndDraw(mode, shaderPtr, srcPixel, &roundedRect);
+        blendAndDraw(paint, mode, srcPixel, &roundedRect);
+        bool fullRows = coversRows(roundedRect);
+        updateOpaqueRows(roundedRect.fTop, roundedRect.fBottom, fullRows, mode, isSrcOpaque(paint));
     }
 
     /**
@@ -466,97 +373,450 @@ public:
      *  following the same "containment" rule as rectangles.
      */
     void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) {
+        drawConvexPolygons(points, &count, 1, paint);
+    }
+
+    /**
+     *  Fill polyCount convex polygons with the same paint. The points of all the polygons
+     *  are one after the other in points[], with counts[i] points in polygon i.
+     */
+    void drawConvexPolygons(const GPoint points[], const int counts[], int polyCount,
+                            const GPaint& paint) {
+        // strokes are drawn as paths (all of the polygons in one, so overlaps blend once)
+        if (paint.isStroke()) {
+            drawPath(PolygonOutlines(points, counts, polyCount), paint);
+            return;
+        }
 
-        if (count <= 2) return;
-        
         // set up CTM
-        if (mxStack.empty()) {
-            GMatrix id = GMatrix();
-            mxStack.push(id);
+        GMatrix CTM = state().ctm;
+
+        // if there is a shader, set context
+        GShader* shaderPtr = paint.getShader();
+        if (!setShaderContext(shaderPtr, CTM)) return;
+
+        // get paint info
+        GPixel srcPixel = ColorToPixel(paint.getColor());
+        GBlendMode mode = paint.getBlendMode();
+
+        // optimize based on modes & opacity
+        if (paint.getAlpha() == 0) {
+            if (mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
+                mode == GBlendMode::kDstOut || mode == GBlendMode::kSrcATop) return;
         }
-        GMatrix CTM = mxStack.top();
+        mode = optimizeMode(shaderPtr, mode, paint.getAlpha());
+        bool srcOpaque = isSrcOpaque(paint);
+
+        // one blitter for polygons over rows that are known to be opaque, one for the rest,
+        // both set up just once for all the polygons
+        GBlendMode opaqueDstMode = optimizeModeForOpaqueDst(mode);
+        const State& st = state();
+        Blitter blitter(fDevice, st.clip, st.mask.get(), paint, mode, srcPixel,
+                        fShadeRow.data(), fMaskRow.data());
+        Blitter opaqueDstBlitter(fDevice, st.clip, st.mask.get(), paint, opaqueDstMode,
+                                 srcPixel, fShadeRow.data(), fMaskRow.data());
+
+        for (int poly = 0; poly < polyCount; poly++) {
+            int count = counts[poly];
+            const GPoint* polyPts = points;
+            points += std::max(count, 0);
+            if (count <= 2) continue;
+
+            // map points based on CTM
+            fArena.reset();
+            GPoint* newPts = fArena.makeArray<GPoint>(count);
+            CTM.mapPoints(newPts, polyPts, count);
+
+            // nothing to do if it's all outside the clip
+            GRect bounds = pointBounds(newPts, count);
+            if (!touchesClip(bounds)) continue;
+
+            // small polygons skip edges & test each pixel in their bounds instead
+            if (!paint.isAntiAlias() && count <= kTinyMaxPoints && isTiny(bounds)) {
+                int rowTop = GFloorToInt(newPts[0].fY);
+                int rowBottom = rowTop;
+                for (int i = 1; i < count; i++) {
+                    rowTop = std::min(rowTop, GFloorToInt(newPts[i].fY));
+                    rowBottom = std::max(rowBottom, GCeilToInt(newPts[i].fY));
+                }
+                bool opaqueDst = rowsAreOpaque(rowTop, rowBottom);
+                updateOpaqueRows(rowTop, rowBottom, false, opaqueDst ? opaqueDstMode : mode,
+                                 srcOpaque);
+                FillTinyConvex(newPts, count, opaqueDst ? opaqueDstBlitter : blitter, fArena);
+                continue;
+            }
+
+            // contruct all edges, clipped to the device (unless it's inside it already)
+            Edge* edges = fArena.makeArray<Edge>(count * 3);
+            int edgeCount = 0;
+            bool needsClip = !insideDevice(bounds);
+            for (int i = 0; i < count; i++) {
+                GPoint next = newPts[(i + 1) % count];
+                edgeCount += needsClip
+                        ? ClipLine(newPts[i], next, fDevice.width(), fDevice.height(),
+                                   paint.isAntiAlias(), edges + edgeCount)
+                        : LineEdge(newPts[i], next, paint.isAntiAlias(), edges + edgeCount);
+            }
+
+            // pick the blitter for the rows it touches
+            int rowTop, rowBottom;
+            edgeRows(edges, edgeCount, paint.isAntiAlias(), &rowTop, &rowBottom);
+            bool opaqueDst = rowsAreOpaque(rowTop, rowBottom);
+            updateOpaqueRows(rowTop, rowBottom, false, opaqueDst ? opaqueDstMode : mode, srcOpaque);
+
+            // draw
+            FillEdges(edges, edgeCount, GPathFillType::kWinding, paint.isAntiAlias(),
+                      opaqueDst ? opaqueDstBlitter : blitter, fArena);
+        }
+    }
+
+    /**
+     *  Fill the round rect: the rectangle with each of its corners rounded off by a quarter of
+     *  the ellipse with radii rx & ry (pinned to half of the rectangle's width & height).
+     */
+    void drawRRect(const GRect& rect, float rx, float ry, const GPaint& paint) {
+        // sort the sides & pin the radii (with no rounding, it's just a rect)
+        GRect sorted = GRect::LTRB(std::min(rect.fLeft, rect.fRight),
+                                   std::min(rect.fTop, rect.fBottom),
+                                   std::max(rect.fLeft, rect.fRight),
+                                   std::max(rect.fTop, rect.fBottom));
+        rx = std::min(rx, sorted.width() / 2);
+        ry = std::min(ry, sorted.height() / 2);
+        if (!(rx > 0 && ry > 0)) {
+            drawRect(rect, paint);
+            return;
+        }
+
+        // set up CTM
+        GMatrix CTM = state().ctm;
+
+        // strokes & round rects that the CTM turns (or skews) are drawn as polygons
+        if (paint.isStroke() || CTM[1] != 0 || CTM[3] != 0) {
+            fShapeArena.reset();
+            int count;
+            GPoint* pts = rrectPoints(sorted, rx, ry, CTM, fShapeArena, &count);
+            if (paint.isStroke()) {
+                drawPath(PolygonOutlines(pts, &count, 1), paint);
+            } else {
+                drawConvexPolygon(pts, count, paint);
+            }
+            return;
+        }
+
+        // otherwise it's still a round rect on the device, just moved & scaled
+        GPoint corners[2] = {{sorted.fLeft, sorted.fTop}, {sorted.fRight, sorted.fBottom}};
+        CTM.mapPoints(corners, 2);
+        GRect bounds = pointBounds(corners, 2);
+        if (!touchesClip(bounds)) return;
 
         // if there is a shader, set context
         GShader* shaderPtr = paint.getShader();
-        if (shaderPtr != nullptr) {
-            bool sh = shaderPtr->setContext(CTM);
-            if (!sh) return;
+        if (!setShaderContext(shaderPtr, CTM)) return;
+
+        // get paint info
+        GPixel srcPixel = ColorToPixel(paint.getColor());
+        GBlendMode mode = paint.getBlendMode();
+
+        // optimize based on modes & opacity
+        if (paint.getAlpha() == 0) {
+            if (mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
+                mode == GBlendMode::kDstOut || mode == GBlendMode::kSrcATop) return;
         }
+        mode = optimizeMode(shaderPtr, mode, paint.getAlpha());
 
-        // map points based on CTM
-        GPoint newPts[count];
-        CTM.mapPoints(newPts, points, count);
+        // the rows it can touch, to check & update which ones are opaque
+        int rowTop = GFloorToInt(bounds.fTop);
+        int rowBottom = GCeilToInt(bounds.fBottom);
+        if (rowsAreOpaque(rowTop, rowBottom)) mode = optimizeModeForOpaqueDst(mode);
+        updateOpaqueRows(rowTop, rowBottom, false, mode, isSrcOpaque(paint));
+
+        // draw, straight from the shape (no edges)
+        Blitter blitter(fDevice, state().clip, state().mask.get(), paint, mode, srcPixel,
+                        fShadeRow.data(), fMaskRow.data());
+        fArena.reset();
+        FillRRect(bounds, rx * fabsf(CTM[0]), ry * fabsf(CTM[4]), paint.isAntiAlias(), blitter,
+                  fArena);
+    }
+
+    /**
+     *  Fill the path with the paint, using the path's fill type to decide which areas are
+     *  inside it. The path may be concave, self-intersecting & have any number of contours.
+     */
+    void drawPath(const GPath& path, const GPaint& paint) {
+        // set up CTM
+        GMatrix CTM = state().ctm;
+
+        // nothing to do if it's all outside the clip (checked before building any edges)
+        // (strokes reach a little past the points)
+        GRect pathBounds = path.bounds();
+        if (paint.isStroke()) {
+            float outset = StrokeOutset(paint);
+            pathBounds = GRect::LTRB(pathBounds.fLeft - outset, pathBounds.fTop - outset,
+                                     pathBounds.fRight + outset, pathBounds.fBottom + outset);
+        }
+        GPoint corners[4] = {{pathBounds.fLeft, pathBounds.fTop},
+                             {pathBounds.fRight, pathBounds.fTop},
+                             {pathBounds.fRight, pathBounds.fBottom},
+                             {pathBounds.fLeft, pathBounds.fBottom}};
+        CTM.mapPoints(corners, 4);
+        GRect bounds = pointBounds(corners, 4);
+        if (!touchesClip(bounds)) return;
+
+        // a stroke is filled as the path of its pieces
+        if (paint.isStroke()) {
+            GPath stroke;
+            StrokePath(path, paint, CTM, &stroke);
+            GPaint fill = paint;
+            fill.setStroke(false);
+            drawPath(stroke, fill);
+            return;
+        }
+
+        // if there is a shader, set context
+        GShader* shaderPtr = paint.getShader();
+        if (!setShaderContext(shaderPtr, CTM)) return;
 
         // get paint info
         GPixel srcPixel = ColorToPixel(paint.getColor());
         GBlendMode mode = paint.getBlendMode();
-        
+
         // optimize based on modes & opacity
-        if (shaderPtr==nullptr && paint.getAlpha() == 0) {
+        if (paint.getAlpha() == 0) {
             if (mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
                 mode == GBlendMode::kDstOut || mode == GBlendMode::kSrcATop) return;
         }
         mode = optimizeMode(shaderPtr, mode, paint.getAlpha());
 
-        // contruct all edges
-        Edge allEdges[count];
-        for (int i = 0; i < count - 1; i++) {
-            allEdges[i] = Edge(newPts[i], newPts[i+1]);
+        int edgeCount;
+        Edge* edges = pathEdges(path, CTM, bounds, paint.isAntiAlias(), &edgeCount);
+        drawEdges(edges, edgeCount, path.getFillType(), paint, mode, srcPixel);
+    }
+
+private:
+    // Note: we store a copy of the bitmap
+    const GBitmap fDevice;
+    // only the pixels in here are ever drawn (the clip is always inside it)
+    const GIRect fClip;
+    const bool fSetsShaderContext;
+    // one (clipped) device row of scratch space for shaders to write into before blending
+    std::vector<GPixel> fShadeRow;
+    // & for mixing anti-aliased rows with the clip mask
+    std::vector<uint8_t> fMaskRow;
+
+    // the current state (which is just the whole clip, with no CTM, until there is one)
+    State& state() {
+        if (mxStack.empty()) mxStack.push({GMatrix(), fClip, nullptr});
+        return mxStack.top();
+    }
+
+    static GIRect intersect(const GIRect& a, const GIRect& b) {
+        GIRect r = GIRect::LTRB(std::max(a.fLeft, b.fLeft), std::max(a.fTop, b.fTop),
+                                std::min(a.fRight, b.fRight), std::min(a.fBottom, b.fBottom));
+        return r.isEmpty() ? GIRect::LTRB(0, 0, 0, 0) : r;
+    }
+
+    /**
+     *  Builds the edges of the path mapped by the CTM, including the ones that close each
+     *  contour, in the arena. Each line is mapped as it's walked, so a path of lines is never
+     *  copied. They're clipped to the device unless the (device) bounds say it's inside.
+     */
+    Edge* pathEdges(const GPath& path, const GMatrix& ctm, const GRect& bounds, bool antiAlias,
+                    int* edgeCount) {
+        // curves are flattened into lines first, once they're on the device (so they get
+        // just enough lines for how big they are there)
+        if (path.hasCurves()) {
+            GPath device = path;
+            device.transform(ctm);
+            return pathEdges(device.flattened(kCurveTolerance), GMatrix(), bounds, antiAlias,
+                             edgeCount);
+        }
+
+        // (each contour has at most as many lines as points, & each line clips to 3 edges)
+        fArena.reset();
+        Edge* edges = fArena.makeArray<Edge>(path.countPoints() * 3);
+        int count = 0;
+        bool needsClip = !insideDevice(bounds);
+        GPath::Edger edger(path);
+        GPoint pts[2];
+        while (edger.next(pts) == GPath::kLine) {
+            ctm.mapPoints(pts, 2);
+            count += needsClip
+                    ? ClipLine(pts[0], pts[1], fDevice.width(), fDevice.height(), antiAlias,
+                               edges + count)
+                    : LineEdge(pts[0], pts[1], antiAlias, edges + count);
+        }
+        *edgeCount = count;
+        return edges;
+    }
+
+    /**
+     *  The points around a (sorted, pinned) round rect, clockwise from the top of its top
+     *  right corner, with enough on each corner that the polygon stays within a quarter of a
+     *  pixel of the ellipse once the CTM maps it. The points are made in the arena.
+     */
+    static GPoint* rrectPoints(const GRect& rect, float rx, float ry, const GMatrix& ctm,
+                               Arena& arena, int* count) {
+        float scaleX = sqrtf(ctm[0] * ctm[0] + ctm[3] * ctm[3]);
+        float scaleY = sqrtf(ctm[1] * ctm[1] + ctm[4] * ctm[4]);
+        float radius = std::max(rx, ry) * std::max(scaleX, scaleY);
+        const float kTolerance = 0.25f;
+        float step = radius > kTolerance ? 2 * acosf(1 - kTolerance / radius) : (float)M_PI / 2;
+        int steps = std::max(1, std::min((int)ceilf((float)M_PI / 2 / step), 64));
+
+        GPoint centers[4] = {{rect.fRight - rx, rect.fTop + ry},
+                             {rect.fRight - rx, rect.fBottom - ry},
+                             {rect.fLeft + rx, rect.fBottom - ry},
+                             {rect.fLeft + rx, rect.fTop + ry}};
+        *count = 4 * (steps + 1);
+        GPoint* pts = arena.makeArray<GPoint>(*count);
+        GPoint* next = pts;
+        for (int corner = 0; corner < 4; corner++) {
+            float start = (corner - 1) * (float)M_PI / 2;
+            for (int i = 0; i <= steps; i++) {
+                float angle = start + i * (float)M_PI / 2 / steps;
+                *next++ = {centers[corner].fX + rx * cosf(angle),
+                           centers[corner].fY + ry * sinf(angle)};
+            }
+        }
+        return pts;
+    }
+
+    // calls setContext() on the shader if there is one (& this canvas is the one that should)
+    bool setShaderContext(GShader* shader, const GMatrix& ctm) {
+        if (shader == nullptr || !fSetsShaderContext) return true;
+        return shader->setContext(ctm);
+    }
+    // scratch memory for the points & edges of a draw (reset at the start of each one, so
+    // it only grows to fit the biggest draw, & after that never touches the heap)
+    Arena fArena;
+    // & for the outline of a shape that's drawn as a polygon or path (which resets fArena)
+    Arena fShapeArena;
+
+    // the smallest rect holding the (device) points
+    static GRect pointBounds(const GPoint pts[], int count) {
+        float minX = pts[0].fX, minY = pts[0].fY, maxX = minX, maxY = minY;
+        for (int i = 1; i < count; i++) {
+            minX = std::min(minX, pts[i].fX);
+            minY = std::min(minY, pts[i].fY);
+            maxX = std::max(maxX, pts[i].fX);
+            maxY = std::max(maxY, pts[i].fY);
         }
-        // add last edge
-        allEdges[count - 1] = Edge(newPts[count - 1], newPts[0]);
+        return GRect::LTRB(minX, minY, maxX, maxY);
+    }
+
+    // true if the bounds fit in a kTinySize x kTinySize box
+    static bool isTiny(const GRect& bounds) {
+        return bounds.width() <= kTinySize && bounds.height() <= kTinySize;
+    }
 
-        // do clipping function to get new list of edges
-        Edge edgesArrayPtr[count*3];
-        int newEdgeCount = clipEdges(allEdges, count, fDevice.width(), fDevice.height(), edgesArrayPtr);
+    // false if a shape with these (device) bounds can't change any pixel in the clip
+    // (written so bounds with a NaN are rejected too)
+    bool touchesClip(const GRect& bounds) {
+        const GIRect& clip = state().clip;
+        return !clip.isEmpty() &&
+               bounds.fRight > clip.fLeft && bounds.fLeft < clip.fRight &&
+               bounds.fBottom > clip.fTop && bounds.fTop < clip.fBottom;
+    }
 
-        // sort by topY w/ leftmost X as tiebreaker
-        std::sort(edgesArrayPtr, edgesArrayPtr+newEdgeCount, compareEdges);
+    // true if drawing every pixel of rect (inside the clip) covers whole rows of the canvas
+    bool coversRows(const GIRect& rect) {
+        return rect.fLeft <= fClip.fLeft && rect.fRight >= fClip.fRight &&
+               state().mask == nullptr;
+    }
+
+    // true if a shape with these (device) bounds doesn't need its edges clipped
+    bool insideDevice(const GRect& bounds) const {
+        return bounds.fLeft >= 0 && bounds.fTop >= 0 &&
+               bounds.fRight <= fDevice.width() && bounds.fBottom <= fDevice.height();
+    }
+
+    // finds the rows [*top, *bottom) that the (clipped) edges can touch
+    void edgeRows(const Edge edges[], int edgeCount, bool antiAlias, int* top, int* bottom) {
+        int rowTop = fDevice.height();
+        int rowBottom = 0;
+        for (int i = 0; i < edgeCount; i++) {
+            rowTop = std::min(rowTop, edges[i].yTop);
+            rowBottom = std::max(rowBottom, edges[i].yBottom);
+        }
+        // (anti-aliased edges are in sub-rows)
+        if (antiAlias) {
+            rowTop >>= kSuperSampleShift;
+            rowBottom = (rowBottom + (1 << kSuperSampleShift) - 1) >> kSuperSampleShift;
+        }
+        *top = rowTop;
+        *bottom = rowBottom;
+    }
+
+    /**
+     *  Helper function that fills the (clipped) edges with the paint & (optimized) blend mode,
+     *  keeping track of which rows are still opaque
+     */
+    void drawEdges(Edge edges[], int edgeCount, GPathFillType fillType, const GPaint& paint,
+                   GBlendMode mode, GPixel src) {
+        // the rows the edges can touch, to check & update which ones are opaque
+        int rowTop, rowBottom;
+        edgeRows(edges, edgeCount, paint.isAntiAlias(), &rowTop, &rowBottom);
+        if (rowsAreOpaque(rowTop, rowBottom)) mode = optimizeModeForOpaqueDst(mode);
+        updateOpaqueRows(rowTop, rowBottom, false, mode, isSrcOpaque(paint));
 
         // draw
-        int trackEdges = 2;
-        int yStart = edgesArrayPtr[0].yTop;
-        for (int y = yStart; y < fDevice.height(); y++) {
-
-            float hit = edgesArrayPtr[0].xIntersect(y + 0.5f);
-            int x1 = GRoundToInt(hit);
-            float hit2 = edgesArrayPtr[1].xIntersect(y + 0.5f);
-            int x2 = GRoundToInt(hit2);
-            int xStart = std::min(x1, x2);
-            int xEnd = std::max(x1, x2);
-
-            // draw each row using drawRect w/ height 1
-            if (xStart != xEnd) {
-                GIRect rowRect = {xStart, y, xEnd, y+1};
-                blendAndDraw(mode, shaderPtr, srcPixel, &rowRect);
-            }
+        Blitter blitter(fDevice, state().clip, state().mask.get(), paint, mode, src,
+                        fShadeRow.data(), fMaskRow.data());
+        FillEdges(edges, edgeCount, fillType, paint.isAntiAlias(), blitter, fArena);
+    }
 
-            // when y passes yBottom of an edge, swap it w/ next highest edge
-            if (y+1 >= edgesArrayPtr[0].yBottom) {
-                edgesArrayPtr[0] = edgesArrayPtr[trackEdges];
-                trackEdges++;
-            }
-            if (y+1 >= edgesArrayPtr[1].yBottom) {
-                edgesArrayPtr[1] = edgesArrayPtr[trackEdges];
-                trackEdges++;
-            }
-            if (trackEdges - 2 >= newEdgeCount - 1) break;
+    // fOpaqueRows[y] is true when every pixel in row y (inside the clip) is known to have
+    // alpha 255 (starts out all false, since we don't know what was in the bitmap before us)
+    std::vector<bool> fOpaqueRows;
 
+    bool rowsAreOpaque(int top, int bottom) const {
+        top = std::max(top, fClip.fTop);
+        bottom = std::min(bottom, fClip.fBottom);
+        if (top >= bottom) return false;
+        for (int y = top; y < bottom; y++) {
+            if (!fOpaqueRows[y]) return false;
         }
+        return true;
     }
 
-private:
-    // Note: we store a copy of the bitmap
-    const GBitmap fDevice;
+    /**
+     *  Updates fOpaqueRows after drawing in rows [top, bottom) with the (optimized) mode.
+     *  fullRows is true if the draw covered every pixel in those rows (inside the clip).
+     */
+    void updateOpaqueRows(int top, int bottom, bool fullRows, GBlendMode mode, bool srcOpaque) {
+        // modes that leave an opaque dst opaque
+        bool keepsOpaque = mode == GBlendMode::kDst || mode == GBlendMode::kSrcOver ||
+                           mode == GBlendMode::kDstOver || mode == GBlendMode::kSrcATop;
+        if (srcOpaque) {
+            keepsOpaque = keepsOpaque || mode == GBlendMode::kSrc || mode == GBlendMode::kSrcIn ||
+                          mode == GBlendMode::kDstIn || mode == GBlendMode::kDstATop;
+        }
+        // modes that make any dst opaque
+        bool makesOpaque = srcOpaque && (mode == GBlendMode::kSrc ||
+                                         mode == GBlendMode::kSrcOver ||
+                                         mode == GBlendMode::kDstOver);
+
+        top = std::max(top, fClip.fTop);
+        bottom = std::min(bottom, fClip.fBottom);
+        for (int y = top; y < bottom; y++) {
+            if (fullRows && makesOpaque) fOpaqueRows[y] = true;
+            else if (!keepsOpaque) fOpaqueRows[y] = false;
+        }
+    }
 };
 
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& device) {
     return std::unique_ptr<GCanvas>(new MyCanvas(device));
 }
 
+std::unique_ptr<GCanvas> CreateClippedCanvas(const GBitmap& device, const GIRect& clip,
+                                             bool setsShaderContext) {
+    return std::unique_ptr<GCanvas>(new MyCanvas(device, clip, setsShaderContext));
+}
+
 
 
-class WaveShader : public GShader {
+class WaveShader : public FloatShader {
     const GMatrix fLocalMatrix;
     const float fScale;
     const float fWaveDepth;
@@ -576,13 +836,11 @@ public:
         return (ctm * fLocalMatrix).invert(&fInverse);
     }
     
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        GColor color;
+    void shadeRowF(int x, int y, int count, GColor row[]) override {
         for (int i = 0; i < count; ++i) {
-            float newY = y + (float)sin(fScale * i) * fWaveDepth;
+            float newY = y + (float)sin(fScale * (x + i)) * fWaveDepth;
             float rad = fScale * newY / M_PI;
-            color = {abs((float)sin(rad)), 1, 0, 1};
-            row[i] = ColorToPixel(color);
+            row[i] = {abs((float)sin(rad)), 1, 0, 1};
         }
     }
 };
@@ -0,0 +1,20 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef MyCanvas_DEFINED
+#define MyCanvas_DEFINED
+
+#include "include/GCanvas.h"
+#include "include/GRect.h"
+
+/**
+ *  Makes a canvas that only draws the pixels of device inside clip, with exactly the same
+ *  values a canvas for the whole device would give them. If setsShaderContext is false the
+ *  canvas never calls setContext() on shaders, so the caller has to (with the CTM) before
+ *  each draw that uses one.
+ */
+std::unique_ptr<GCanvas> CreateClippedCanvas(const GBitmap& device, const GIRect& clip,
+                                             bool setsShaderContext);
+
+#endif
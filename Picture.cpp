@@ -0,0 +1,580 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "include/GPicture.h"
+#include "include/GPath.h"
+#include "include/GPoint.h"
+#include "include/GRect.h"
+#include "include/GShader.h"
+#include "Arena.h"
+#include "Stroker.h"
+
+#include <cstring>
+#include <vector>
+
+// The recorded calls. Each one is allocated in the picture's arena, one after the other, so
+// playing back walks through a few big blocks instead of pointers all over the heap.
+
+enum class OpType : uint8_t {
+    kSave,
+    kRestore,
+    kConcat,
+    kClipRect,
+    kClipPath,
+    kDrawPaint,
+    kDrawRect,
+    kDrawRRect,
+    kDrawConvexPolygon,
+    kDrawConvexPolygons,
+    kDrawPath,
+};
+
+struct Op {
+    OpType type;
+};
+
+struct ConcatOp : Op {
+    static const OpType kType = OpType::kConcat;
+    GMatrix matrix;
+};
+
+struct ClipRectOp : Op {
+    static const OpType kType = OpType::kClipRect;
+    GRect rect;
+};
+
+struct ClipPathOp : Op {
+    static const OpType kType = OpType::kClipPath;
+    int pathIndex;          // in Picture::fPaths
+    bool antiAlias;
+};
+
+struct DrawPaintOp : Op {
+    static const OpType kType = OpType::kDrawPaint;
+    GPaint paint;
+};
+
+struct DrawRectOp : Op {
+    static const OpType kType = OpType::kDrawRect;
+    GPaint paint;
+    GRect rect;
+};
+
+struct DrawRRectOp : Op {
+    static const OpType kType = OpType::kDrawRRect;
+    GPaint paint;
+    GRect rect;
+    float rx, ry;
+};
+
+// kDrawConvexPolygon has a single polygon of count points, & leaves counts null
+struct DrawPolygonsOp : Op {
+    static const OpType kType = OpType::kDrawConvexPolygons;
+    GPaint paint;
+    const GPoint* points;
+    const int* counts;
+    int count;              // points (kDrawConvexPolygon) or polygons (kDrawConvexPolygons)
+};
+
+struct DrawPathOp : Op {
+    static const OpType kType = OpType::kDrawPath;
+    GPaint paint;
+    int pathIndex;          // in Picture::fPaths
+};
+
+// Occlusion culling: what a later opaque rect does to an earlier draw, for one playback.
+// Only rects (& drawPaint) that set their pixels to something that doesn't depend on the dst
+// hide anything, & only draws whose bounds they fully cover (or rects they cover a whole side
+// of) are changed, so the pixels come out exactly the same.
+
+// how one op draws into the device it's being played back into
+struct DrawInfo {
+    GIRect bounds;          // pixels the op might change (empty if none, or it's not a draw)
+    GIRect opaque;          // pixels it sets without reading them (empty if none)
+    bool exactRect;         // bounds are exactly the pixels it changes (an aliased rect)
+    GMatrix ctm;            // the CTM, for exact rects
+    bool culled;            // leave it out
+    bool trimmed;           // draw just trimRect instead
+    GRect trimRect;
+};
+
+static const GIRect kEmptyIRect = GIRect::LTRB(0, 0, 0, 0);
+
+static GIRect Intersect(const GIRect& a, const GIRect& b) {
+    GIRect r = GIRect::LTRB(std::max(a.fLeft, b.fLeft), std::max(a.fTop, b.fTop),
+                            std::min(a.fRight, b.fRight), std::min(a.fBottom, b.fBottom));
+    return r.isEmpty() ? kEmptyIRect : r;
+}
+
+static bool Contains(const GIRect& outer, const GIRect& inner) {
+    return outer.fLeft <= inner.fLeft && outer.fTop <= inner.fTop &&
+           outer.fRight >= inner.fRight && outer.fBottom >= inner.fBottom;
+}
+
+static int64_t Area(const GIRect& r) {
+    return r.isEmpty() ? 0 : (int64_t)r.width() * r.height();
+}
+
+// the pixels that the points (once mapped) might touch, with one more on every side for
+// anti-aliasing & rounding
+static GIRect PixelBounds(const GMatrix& ctm, const GPoint pts[], int count) {
+    if (count <= 0) return kEmptyIRect;
+    GPoint p = ctm * pts[0];
+    float left = p.fX, top = p.fY, right = p.fX, bottom = p.fY;
+    for (int i = 1; i < count; i++) {
+        p = ctm * pts[i];
+        left = std::min(left, p.fX);
+        top = std::min(top, p.fY);
+        right = std::max(right, p.fX);
+        bottom = std::max(bottom, p.fY);
+    }
+    return GIRect::LTRB(GFloorToInt(left) - 1, GFloorToInt(top) - 1,
+                        GCeilToInt(right) + 1, GCeilToInt(bottom) + 1);
+}
+
+// the pixels that the paint might touch drawing the shape with the points: if it's a stroke,
+// that reaches past the points' bounds
+static GIRect DrawBounds(const GMatrix& ctm, const GPoint pts[], int count,
+                         const GPaint& paint) {
+    if (!paint.isStroke() || count <= 0) return PixelBounds(ctm, pts, count);
+
+    float left = pts[0].fX, top = pts[0].fY, right = pts[0].fX, bottom = pts[0].fY;
+    for (int i = 1; i < count; i++) {
+        left = std::min(left, pts[i].fX);
+        top = std::min(top, pts[i].fY);
+        right = std::max(right, pts[i].fX);
+        bottom = std::max(bottom, pts[i].fY);
+    }
+    float outset = StrokeOutset(paint);
+    GPoint corners[4] = {{left - outset, top - outset}, {right + outset, top - outset},
+                         {right + outset, bottom + outset}, {left - outset, bottom + outset}};
+    return PixelBounds(ctm, corners, 4);
+}
+
+/**
+ *  If the canvas fills the rect as just its mapped corners rounded to pixels (the CTM only
+ *  scales & translates, & it's aliased or lands on whole pixels), returns true with those
+ *  pixels. Rotated, flipped & fractional anti-aliased rects go down the polygon path.
+ */
+static bool RectPixels(const GMatrix& ctm, const GRect& rect, const GPaint& paint,
+                       GIRect* pixels) {
+    if (paint.isStroke()) return false;
+    if (ctm[1] != 0 || ctm[3] != 0 || !(ctm[0] > 0) || !(ctm[4] > 0)) return false;
+    GPoint corners[2] = {{rect.fLeft, rect.fTop}, {rect.fRight, rect.fBottom}};
+    ctm.mapPoints(corners, 2);
+    if (paint.isAntiAlias()) {
+        for (const GPoint& p : corners) {
+            if (p.fX != floorf(p.fX) || p.fY != floorf(p.fY)) return false;
+        }
+    }
+    *pixels = GRect::LTRB(corners[0].fX, corners[0].fY, corners[1].fX, corners[1].fY).round();
+    return true;
+}
+
+// what a save level's clip lets through (in device pixels)
+struct ClipInfo {
+    GMatrix ctm;
+    GIRect bounds;          // no pixels outside these are drawn
+    bool isRect;            // every pixel inside bounds is drawn (it's not a path's mask)
+};
+
+// true if the paint sets every pixel it draws without reading it
+static bool PaintHidesDst(const GPaint& paint, const GMatrix& ctm) {
+    GShader* shader = paint.getShader();
+    GBlendMode mode = paint.getBlendMode();
+    if (mode == GBlendMode::kSrcOver) {
+        if (paint.getAlpha() != 1 || (shader != nullptr && !shader->isOpaque())) return false;
+    } else if (mode != GBlendMode::kSrc) {
+        return false;
+    }
+    // a shader that can't be set up draws nothing at all
+    return shader == nullptr || shader->setContext(ctm);
+}
+
+class Picture : public GPicture {
+public:
+    void playback(GCanvas* canvas, GPictureStats* stats) const override {
+        GPictureStats cullStats;
+        std::vector<DrawInfo> infos;
+        GMatrix ctm;
+        GIRect device;
+        if (canvas->getDeviceState(&ctm, &device)) {
+            this->cull(ctm, device, &infos, &cullStats);
+        }
+        if (stats != nullptr) *stats = cullStats;
+
+        canvas->save();
+        for (size_t i = 0; i < fOps.size(); i++) {
+            const Op* op = fOps[i];
+            if (!infos.empty() && infos[i].culled) continue;
+            switch (op->type) {
+                case OpType::kSave:
+                    canvas->save();
+                    break;
+                case OpType::kRestore:
+                    canvas->restore();
+                    break;
+                case OpType::kConcat:
+                    canvas->concat(static_cast<const ConcatOp*>(op)->matrix);
+                    break;
+                case OpType::kClipRect:
+                    canvas->clipRect(static_cast<const ClipRectOp*>(op)->rect);
+                    break;
+                case OpType::kClipPath: {
+                    const ClipPathOp* clip = static_cast<const ClipPathOp*>(op);
+                    canvas->clipPath(fPaths[clip->pathIndex], clip->antiAlias);
+                    break;
+                }
+                case OpType::kDrawPaint:
+                    canvas->drawPaint(static_cast<const DrawPaintOp*>(op)->paint);
+                    break;
+                case OpType::kDrawRect: {
+                    const DrawRectOp* rect = static_cast<const DrawRectOp*>(op);
+                    bool trimmed = !infos.empty() && infos[i].trimmed;
+                    canvas->drawRect(trimmed ? infos[i].trimRect : rect->rect, rect->paint);
+                    break;
+                }
+                case OpType::kDrawRRect: {
+                    const DrawRRectOp* rrect = static_cast<const DrawRRectOp*>(op);
+                    canvas->drawRRect(rrect->rect, rrect->rx, rrect->ry, rrect->paint);
+                    break;
+                }
+                case OpType::kDrawConvexPolygon: {
+                    const DrawPolygonsOp* poly = static_cast<const DrawPolygonsOp*>(op);
+                    canvas->drawConvexPolygon(poly->points, poly->count, poly->paint);
+                    break;
+                }
+                case OpType::kDrawConvexPolygons: {
+                    const DrawPolygonsOp* polys = static_cast<const DrawPolygonsOp*>(op);
+                    canvas->drawConvexPolygons(polys->points, polys->counts, polys->count,
+                                               polys->paint);
+                    break;
+                }
+                case OpType::kDrawPath: {
+                    const DrawPathOp* path = static_cast<const DrawPathOp*>(op);
+                    canvas->drawPath(fPaths[path->pathIndex], path->paint);
+                    break;
+                }
+            }
+        }
+        canvas->restore();
+    }
+
+    int count() const override { return (int)fOps.size(); }
+
+    // never reset, so everything in it lasts as long as the picture
+    Arena fArena;
+    std::vector<const Op*> fOps;
+    // paths own their points, so they're kept out here instead of in the arena
+    std::vector<GPath> fPaths;
+
+    // adds a new op of type T (or of type, for ops that share a struct)
+    template <typename T> T* append(OpType type = T::kType) {
+        T* op = fArena.make<T>();
+        op->type = type;
+        fOps.push_back(op);
+        return op;
+    }
+
+    // copies the array into the arena
+    template <typename T> const T* copy(const T src[], int count) {
+        T* dst = fArena.makeArray<T>(count);
+        if (count > 0) memcpy(dst, src, count * sizeof(T));
+        return dst;
+    }
+
+private:
+    static const int kMaxOccluders = 4;
+
+    /**
+     *  Works out which draws to leave out or trim when played back from ctm into the device
+     *  pixels, filling in infos (one per op). Leaves infos empty if it gives up.
+     */
+    void cull(const GMatrix& startCTM, const GIRect& device, std::vector<DrawInfo>* infos,
+              GPictureStats* stats) const {
+        // forwards, to find where each draw lands
+        infos->resize(fOps.size());
+        std::vector<ClipInfo> levels(1, {startCTM, device, true});
+        for (size_t i = 0; i < fOps.size(); i++) {
+            const Op* op = fOps[i];
+            const GMatrix ctm = levels.back().ctm;
+            const GIRect clip = levels.back().bounds;
+            DrawInfo& info = (*infos)[i];
+            info.bounds = info.opaque = kEmptyIRect;
+            info.exactRect = info.culled = info.trimmed = false;
+
+            switch (op->type) {
+                case OpType::kSave:
+                    levels.push_back(levels.back());
+                    break;
+                case OpType::kRestore:
+                    // restoring past the start of the picture isn't something to follow
+                    if (levels.size() == 1) {
+                        infos->clear();
+                        return;
+                    }
+                    levels.pop_back();
+                    break;
+                case OpType::kConcat:
+                    levels.back().ctm = GMatrix::Concat(ctm,
+                                                        static_cast<const ConcatOp*>(op)->matrix);
+                    break;
+                case OpType::kClipRect: {
+                    // an axis-aligned rect clips to exactly its rounded corners, like the canvas
+                    const GRect& r = static_cast<const ClipRectOp*>(op)->rect;
+                    GPoint corners[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop},
+                                         {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+                    GIRect clip;
+                    if (ctm[1] == 0 && ctm[3] == 0) {
+                        ctm.mapPoints(corners, 4);
+                        clip = GRect::LTRB(std::min(corners[0].fX, corners[2].fX),
+                                           std::min(corners[0].fY, corners[2].fY),
+                                           std::max(corners[0].fX, corners[2].fX),
+                                           std::max(corners[0].fY, corners[2].fY)).round();
+                    } else {
+                        clip = PixelBounds(ctm, corners, 4);
+                        levels.back().isRect = false;
+                    }
+                    levels.back().bounds = Intersect(levels.back().bounds, clip);
+                    break;
+                }
+                case OpType::kClipPath: {
+                    GRect r = fPaths[static_cast<const ClipPathOp*>(op)->pathIndex].bounds();
+                    GPoint corners[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop},
+                                         {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+                    levels.back().bounds = Intersect(levels.back().bounds,
+                                                     PixelBounds(ctm, corners, 4));
+                    levels.back().isRect = false;
+                    break;
+                }
+                case OpType::kDrawPaint:
+                    info.bounds = clip;
+                    if (PaintHidesDst(static_cast<const DrawPaintOp*>(op)->paint, ctm)) {
+                        info.opaque = clip;
+                    }
+                    break;
+                case OpType::kDrawRect: {
+                    const DrawRectOp* rect = static_cast<const DrawRectOp*>(op);
+                    GIRect pixels;
+                    if (RectPixels(ctm, rect->rect, rect->paint, &pixels)) {
+                        info.bounds = Intersect(pixels, clip);
+                        info.exactRect = !rect->paint.isAntiAlias();
+                        info.ctm = ctm;
+                        if (PaintHidesDst(rect->paint, ctm)) info.opaque = info.bounds;
+                    } else {
+                        const GRect& r = rect->rect;
+                        GPoint corners[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop},
+                                             {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+                        info.bounds = Intersect(DrawBounds(ctm, corners, 4, rect->paint), clip);
+                    }
+                    break;
+                }
+                case OpType::kDrawRRect: {
+                    // (its rect bounds it, but with its corners cut off it never hides anything)
+                    const DrawRRectOp* rrect = static_cast<const DrawRRectOp*>(op);
+                    const GRect& r = rrect->rect;
+                    GPoint corners[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop},
+                                         {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+                    info.bounds = Intersect(DrawBounds(ctm, corners, 4, rrect->paint), clip);
+                    break;
+                }
+                case OpType::kDrawConvexPolygon: {
+                    const DrawPolygonsOp* poly = static_cast<const DrawPolygonsOp*>(op);
+                    GIRect bounds = DrawBounds(ctm, poly->points, poly->count, poly->paint);
+                    info.bounds = Intersect(bounds, clip);
+                    break;
+                }
+                case OpType::kDrawConvexPolygons: {
+                    const DrawPolygonsOp* polys = static_cast<const DrawPolygonsOp*>(op);
+                    int pointCount = 0;
+                    for (int p = 0; p < polys->count; p++) {
+                        pointCount += std::max(polys->counts[p], 0);
+                    }
+                    GIRect bounds = DrawBounds(ctm, polys->points, pointCount, polys->paint);
+                    info.bounds = Intersect(bounds, clip);
+                    break;
+                }
+                case OpType::kDrawPath: {
+                    const DrawPathOp* path = static_cast<const DrawPathOp*>(op);
+                    GRect r = fPaths[path->pathIndex].bounds();
+                    GPoint corners[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop},
+                                         {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+                    info.bounds = Intersect(DrawBounds(ctm, corners, 4, path->paint), clip);
+                    break;
+                }
+            }
+            // a path's mask may let only part of the pixels through, so they can't hide any
+            if (!levels.back().isRect) info.opaque = kEmptyIRect;
+        }
+
+        // backwards, keeping the biggest few opaque rects drawn after each op
+        GIRect occluders[kMaxOccluders];
+        int occluderCount = 0;
+        for (size_t i = infos->size(); i-- > 0;) {
+            DrawInfo& info = (*infos)[i];
+            if (info.bounds.isEmpty()) continue;
+
+            bool hidden = false;
+            for (int k = 0; k < occluderCount && !hidden; k++) {
+                hidden = Contains(occluders[k], info.bounds);
+            }
+            if (hidden) {
+                info.culled = true;
+                stats->culledDraws++;
+                stats->pixelsSaved += Area(info.bounds);
+                continue;
+            }
+
+            if (info.exactRect) {
+                this->trim(&info, occluders, occluderCount, stats);
+            }
+
+            if (!info.opaque.isEmpty()) {
+                // replace the smallest occluder, if this one is bigger
+                int slot = occluderCount;
+                if (occluderCount == kMaxOccluders) {
+                    slot = 0;
+                    for (int k = 1; k < kMaxOccluders; k++) {
+                        if (Area(occluders[k]) < Area(occluders[slot])) slot = k;
+                    }
+                    if (Area(occluders[slot]) >= Area(info.opaque)) continue;
+                } else {
+                    occluderCount++;
+                }
+                occluders[slot] = info.opaque;
+            }
+        }
+    }
+
+    // cuts the sides of an exact rect that the occluders cover off of it
+    void trim(DrawInfo* info, const GIRect occluders[], int count, GPictureStats* stats) const {
+        GIRect r = info->bounds;
+        for (int k = 0; k < count; k++) {
+            const GIRect& o = occluders[k];
+            if (o.fLeft <= r.fLeft && o.fRight >= r.fRight) {
+                // covers whole rows, so it can take off the top or the bottom
+                if (o.fTop <= r.fTop && o.fBottom > r.fTop) r.fTop = o.fBottom;
+                else if (o.fBottom >= r.fBottom && o.fTop < r.fBottom) r.fBottom = o.fTop;
+            } else if (o.fTop <= r.fTop && o.fBottom >= r.fBottom) {
+                // covers whole columns, so it can take off the left or the right
+                if (o.fLeft <= r.fLeft && o.fRight > r.fLeft) r.fLeft = o.fRight;
+                else if (o.fRight >= r.fRight && o.fLeft < r.fRight) r.fRight = o.fLeft;
+            }
+        }
+        if (Area(r) == Area(info->bounds)) return;
+
+        // back to local coordinates: the edges map to whole pixels (give or take a little
+        // float error), so they round to the same ones
+        GMatrix inverse;
+        if (!info->ctm.invert(&inverse)) return;
+        GPoint corners[2] = {{(float)r.fLeft, (float)r.fTop}, {(float)r.fRight, (float)r.fBottom}};
+        inverse.mapPoints(corners, 2);
+
+        stats->trimmedDraws++;
+        stats->pixelsSaved += Area(info->bounds) - Area(r);
+        info->trimmed = true;
+        info->trimRect = GRect::LTRB(corners[0].fX, corners[0].fY, corners[1].fX, corners[1].fY);
+        info->bounds = r;
+    }
+};
+
+/**
+ *  Appends each call made on it to a picture, instead of drawing anything.
+ */
+class RecordingCanvas : public GCanvas {
+public:
+    RecordingCanvas() : fPicture(new Picture) {}
+
+    // hands over the picture recorded so far
+    std::unique_ptr<GPicture> finish() {
+        return std::move(fPicture);
+    }
+
+    void save() override {
+        fPicture->append<Op>(OpType::kSave);
+    }
+
+    void restore() override {
+        fPicture->append<Op>(OpType::kRestore);
+    }
+
+    void concat(const GMatrix& matrix) override {
+        fPicture->append<ConcatOp>()->matrix = matrix;
+    }
+
+    void clipRect(const GRect& rect) override {
+        fPicture->append<ClipRectOp>()->rect = rect;
+    }
+
+    void clipPath(const GPath& path, bool antiAlias) override {
+        ClipPathOp* op = fPicture->append<ClipPathOp>();
+        op->pathIndex = (int)fPicture->fPaths.size();
+        op->antiAlias = antiAlias;
+        fPicture->fPaths.push_back(path);
+    }
+
+    void drawPaint(const GPaint& paint) override {
+        fPicture->append<DrawPaintOp>()->paint = paint;
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        DrawRectOp* op = fPicture->append<DrawRectOp>();
+        op->paint = paint;
+        op->rect = rect;
+    }
+
+    void drawRRect(const GRect& rect, float rx, float ry, const GPaint& paint) override {
+        DrawRRectOp* op = fPicture->append<DrawRRectOp>();
+        op->paint = paint;
+        op->rect = rect;
+        op->rx = rx;
+        op->ry = ry;
+    }
+
+    void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) override {
+        count = std::max(count, 0);
+        DrawPolygonsOp* op = fPicture->append<DrawPolygonsOp>(OpType::kDrawConvexPolygon);
+        op->paint = paint;
+        op->points = fPicture->copy(points, count);
+        op->counts = nullptr;
+        op->count = count;
+    }
+
+    void drawConvexPolygons(const GPoint points[], const int counts[], int polyCount,
+                            const GPaint& paint) override {
+        polyCount = std::max(polyCount, 0);
+        int pointCount = 0;
+        for (int i = 0; i < polyCount; i++) {
+            pointCount += std::max(counts[i], 0);
+        }
+
+        DrawPolygonsOp* op = fPicture->append<DrawPolygonsOp>();
+        op->paint = paint;
+        op->points = fPicture->copy(points, pointCount);
+        op->counts = fPicture->copy(counts, polyCount);
+        op->count = polyCount;
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        DrawPathOp* op = fPicture->append<DrawPathOp>();
+        op->paint = paint;
+        op->pathIndex = (int)fPicture->fPaths.size();
+        fPicture->fPaths.push_back(path);
+    }
+
+private:
+    std::unique_ptr<Picture> fPicture;
+};
+
+GCanvas* GPictureRecorder::beginRecording() {
+    fCanvas.reset(new RecordingCanvas);
+    return fCanvas.get();
+}
+
+std::unique_ptr<GPicture> GPictureRecorder::finishRecording() {
+    if (!fCanvas) return nullptr;
+    std::unique_ptr<GPicture> picture = static_cast<RecordingCanvas*>(fCanvas.get())->finish();
+    fCanvas.reset();
+    return picture;
+}
@@ -0,0 +1,323 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "RasterPipeline.h"
+#include "BMShader.h"
+
+static_assert(BMShader::kChunkSize <= RasterPipeline::kChunkSize,
+              "bitmap chunks have to fit in a pipeline chunk");
+
+// rounds a premultiplied float color to a pixel, pinning it to a legal premultiplied value
+static GPixel PackColor(const GColor& c) {
+    float a = GPinToUnit(c.a);
+    float r = std::max(0.0f, std::min(a, c.r));
+    float g = std::max(0.0f, std::min(a, c.g));
+    float b = std::max(0.0f, std::min(a, c.b));
+    return GPixel_PackARGB(GRoundToInt(a * 255), GRoundToInt(r * 255),
+                           GRoundToInt(g * 255), GRoundToInt(b * 255));
+}
+
+void FloatShader::shadeRow(int x, int y, int count, GPixel row[]) {
+    GColor colors[RasterPipeline::kChunkSize];
+    for (int offset = 0; offset < count; offset += RasterPipeline::kChunkSize) {
+        int n = std::min(count - offset, (int)RasterPipeline::kChunkSize);
+        this->shadeRowF(x + offset, y, n, colors);
+        for (int i = 0; i < n; i++) {
+            row[offset + i] = PackColor(colors[i]);
+        }
+    }
+}
+
+// pixels [x ... x + n - 1] on row y, on their way through the stages
+struct RasterPipeline::Chunk {
+    int x, y, n;
+    GPixel* dst;                    // where they end up in the device
+
+    // lowp
+    const GPixel* src;              // the src pixels (may point into a shader or rowStorage)
+    GPixel storage[kChunkSize];     // for stages that have to change the src
+
+    // highp
+    GColor srcF[kChunkSize];
+    GColor dstF[kChunkSize];
+};
+
+struct Stages {
+    typedef RasterPipeline::Chunk Chunk;
+
+    // lowp stages below!
+
+    // src *= paint alpha (DstIn with an alpha-only "src" is exactly Div255(Sa * D))
+    static void lowp_scale_alpha(const RasterPipeline& p, Chunk& c) {
+        if (c.src != c.storage) {
+            memcpy(c.storage, c.src, c.n * sizeof(GPixel));
+            c.src = c.storage;
+        }
+        p.fScaleProc(p.fAlphaPixel, c.storage, c.n);
+    }
+
+    // load dst, blend & store, all in one SIMD pass
+    static void lowp_blend(const RasterPipeline& p, Chunk& c) {
+        p.fRowProc(c.src, c.dst, c.n);
+    }
+
+    // same as lowp_blend, but runs of opaque or transparent src are copied or skipped when
+    // the mode allows it (e.g. srcover of a sprite with big transparent borders)
+    static void lowp_blend_runs(const RasterPipeline& p, Chunk& c) {
+        int i = 0;
+        while (i < c.n) {
+            // find the run of pixels that are in the same class as src[i]
+            unsigned a = GPixel_GetA(c.src[i]);
+            bool solid = a == 0 || a == 255;
+            int start = i++;
+            if (solid) {
+                while (i < c.n && GPixel_GetA(c.src[i]) == a) i++;
+            }
+            else {
+                while (i < c.n && GPixel_GetA(c.src[i]) != 0 && GPixel_GetA(c.src[i]) != 255) i++;
+            }
+
+            RasterPipeline::RunAction action = RasterPipeline::kBlend_RunAction;
+            if (solid) action = a == 0 ? p.fTransparentRun : p.fOpaqueRun;
+            switch (action) {
+                case RasterPipeline::kBlend_RunAction:
+                    p.fRowProc(c.src + start, c.dst + start, i - start);
+                    break;
+                case RasterPipeline::kSkip_RunAction:
+                    break;
+                case RasterPipeline::kCopy_RunAction:
+                    memcpy(c.dst + start, c.src + start, (i - start) * sizeof(GPixel));
+                    break;
+            }
+        }
+    }
+
+    static void lowp_store(const RasterPipeline& p, Chunk& c) {
+        memcpy(c.dst, c.src, c.n * sizeof(GPixel));
+    }
+
+    // highp stages below!
+
+    static void highp_shade(const RasterPipeline& p, Chunk& c) {
+        static_cast<FloatShader*>(p.fShader)->shadeRowF(c.x, c.y, c.n, c.srcF);
+    }
+
+    static void highp_scale_alpha(const RasterPipeline& p, Chunk& c) {
+        for (int i = 0; i < c.n; i++) {
+            c.srcF[i] *= GColor::RGBA(p.fAlpha, p.fAlpha, p.fAlpha, p.fAlpha);
+        }
+    }
+
+    static void highp_load_dst(const RasterPipeline& p, Chunk& c) {
+        const float scale = 1 / 255.0f;
+        for (int i = 0; i < c.n; i++) {
+            GPixel d = c.dst[i];
+            c.dstF[i] = GColor::RGBA(GPixel_GetR(d), GPixel_GetG(d), GPixel_GetB(d),
+                                     GPixel_GetA(d)) * scale;
+        }
+    }
+
+    // result = S * Fs + D * Fd, with the coefficients for each mode from GBlendMode.h
+    template <GBlendMode mode>
+    static void highp_blend(const RasterPipeline& p, Chunk& c) {
+        for (int i = 0; i < c.n; i++) {
+            float sa = c.srcF[i].a;
+            float da = c.dstF[i].a;
+            float fs = 0;
+            float fd = 0;
+            switch (mode) {
+                case GBlendMode::kClear:    fs = 0;      fd = 0;      break;
+                case GBlendMode::kSrc:      fs = 1;      fd = 0;      break;
+                case GBlendMode::kDst:      fs = 0;      fd = 1;      break;
+                case GBlendMode::kSrcOver:  fs = 1;      fd = 1 - sa; break;
+                case GBlendMode::kDstOver:  fs = 1 - da; fd = 1;      break;
+                case GBlendMode::kSrcIn:    fs = da;     fd = 0;      break;
+                case GBlendMode::kDstIn:    fs = 0;      fd = sa;     break;
+                case GBlendMode::kSrcOut:   fs = 1 - da; fd = 0;      break;
+                case GBlendMode::kDstOut:   fs = 0;      fd = 1 - sa; break;
+                case GBlendMode::kSrcATop:  fs = da;     fd = 1 - sa; break;
+                case GBlendMode::kDstATop:  fs = 1 - da; fd = sa;     break;
+                case GBlendMode::kXor:      fs = 1 - da; fd = 1 - sa; break;
+            }
+            c.srcF[i] = c.srcF[i] * fs + c.dstF[i] * fd;
+        }
+    }
+
+    static void highp_store(const RasterPipeline& p, Chunk& c) {
+        for (int i = 0; i < c.n; i++) {
+            c.dst[i] = PackColor(c.srcF[i]);
+        }
+    }
+};
+
+// tables are in the same order as GBlendMode
+static const RasterPipeline::StageFn gHighpBlendStages[] = {
+    Stages::highp_blend<GBlendMode::kClear>,
+    Stages::highp_blend<GBlendMode::kSrc>,
+    Stages::highp_blend<GBlendMode::kDst>,
+    Stages::highp_blend<GBlendMode::kSrcOver>,
+    Stages::highp_blend<GBlendMode::kDstOver>,
+    Stages::highp_blend<GBlendMode::kSrcIn>,
+    Stages::highp_blend<GBlendMode::kDstIn>,
+    Stages::highp_blend<GBlendMode::kSrcOut>,
+    Stages::highp_blend<GBlendMode::kDstOut>,
+    Stages::highp_blend<GBlendMode::kSrcATop>,
+    Stages::highp_blend<GBlendMode::kDstATop>,
+    Stages::highp_blend<GBlendMode::kXor>,
+};
+
+RasterPipeline::RasterPipeline(const GPaint& paint, GBlendMode mode, GPixel src,
+                               GPixel rowStorage[])
+    : fShader(paint.getShader()), fRowStorage(rowStorage), fStageCount(0), fSrc(src) {
+    fNoop = mode == GBlendMode::kDst;
+    fHighp = false;
+    fShadeIntoDst = false;
+
+    fAlpha = GPinToUnit(paint.getAlpha());
+    fAlphaPixel = GPixel_PackARGB(GRoundToInt(fAlpha * 255), 0, 0, 0);
+    fRowProc = GetBlendRowProc(mode);
+    fColorProc = GetBlendColorProc(mode);
+    fScaleProc = GetBlendColorProc(GBlendMode::kDstIn);
+    fLerpProc = GetLerpRowProc();
+
+    // S = 0 leaves D as is in these modes (the formulas reduce to Div255(255 * D) = D)
+    bool transparentSkips = mode == GBlendMode::kSrcOver || mode == GBlendMode::kDstOver ||
+                            mode == GBlendMode::kSrcATop || mode == GBlendMode::kDstOut ||
+                            mode == GBlendMode::kXor;
+    fTransparentRun = transparentSkips ? kSkip_RunAction : kBlend_RunAction;
+    // Sa = 255 makes srcover a copy, & dstin leave D as is
+    fOpaqueRun = kBlend_RunAction;
+    if (mode == GBlendMode::kSrcOver) fOpaqueRun = kCopy_RunAction;
+    if (mode == GBlendMode::kDstIn) fOpaqueRun = kSkip_RunAction;
+
+    // a solid color already has its alpha, so lowp just blends it (no stages needed)
+    if (fShader == nullptr) {
+        fSource = kColor_Source;
+        return;
+    }
+    bool scaleAlpha = fAlpha < 1;
+
+    // shaders with float colors go highp
+    if (dynamic_cast<FloatShader*>(fShader) != nullptr) {
+        fSource = kFloat_Source;
+        fHighp = true;
+        this->append(Stages::highp_shade);
+        if (scaleAlpha) this->append(Stages::highp_scale_alpha);
+        // kSrc just stores the src, every other mode needs the dst
+        if (mode != GBlendMode::kSrc) {
+            this->append(Stages::highp_load_dst);
+            this->append(gHighpBlendStages[static_cast<int>(mode)]);
+        }
+        this->append(Stages::highp_store);
+        return;
+    }
+
+    // everything else is 8888 lowp
+    fSource = dynamic_cast<BMShader*>(fShader) != nullptr ? kBitmap_Source : kShader_Source;
+    if (scaleAlpha) this->append(Stages::lowp_scale_alpha);
+    if (mode == GBlendMode::kSrc) {
+        // with nothing to do to the src first, the shader writes straight into the device
+        if (fStageCount == 0) fShadeIntoDst = true;
+        else this->append(Stages::lowp_store);
+    }
+    else if (!fShader->isOpaque() &&
+             (fOpaqueRun != kBlend_RunAction || fTransparentRun != kBlend_RunAction)) {
+        // a shader with alpha may have long runs that don't need the full blend
+        this->append(Stages::lowp_blend_runs);
+    }
+    else {
+        this->append(Stages::lowp_blend);
+    }
+}
+
+void RasterPipeline::runStages(Chunk& chunk) const {
+    for (int i = 0; i < fStageCount; i++) {
+        fStages[i](*this, chunk);
+    }
+}
+
+void RasterPipeline::run(int x, int y, int count, GPixel dst[]) {
+    if (fNoop || count <= 0) return;
+
+    Chunk chunk;
+    chunk.y = y;
+    switch (fSource) {
+        case kColor_Source:
+            fColorProc(fSrc, dst, count);
+            break;
+
+        case kShader_Source:
+            if (fShadeIntoDst) {
+                fShader->shadeRow(x, y, count, dst);
+                break;
+            }
+            fShader->shadeRow(x, y, count, fRowStorage);
+            for (int offset = 0; offset < count; offset += kChunkSize) {
+                chunk.x = x + offset;
+                chunk.n = std::min(count - offset, (int)kChunkSize);
+                chunk.dst = dst + offset;
+                chunk.src = fRowStorage + offset;
+                this->runStages(chunk);
+            }
+            break;
+
+        case kBitmap_Source: {
+            // calling BMShader's functions directly lets its sampling loop be inlined
+            BMShader* bm = static_cast<BMShader*>(fShader);
+            if (fShadeIntoDst) {
+                bm->BMShader::shadeRow(x, y, count, dst);
+                break;
+            }
+            bm->shadeChunks(x, y, count, [&](const GPixel pixels[], int offset, int n) {
+                chunk.x = x + offset;
+                chunk.n = n;
+                chunk.dst = dst + offset;
+                chunk.src = pixels;
+                this->runStages(chunk);
+            });
+            break;
+        }
+
+        case kFloat_Source:
+            for (int offset = 0; offset < count; offset += kChunkSize) {
+                chunk.x = x + offset;
+                chunk.n = std::min(count - offset, (int)kChunkSize);
+                chunk.dst = dst + offset;
+                this->runStages(chunk);
+            }
+            break;
+    }
+}
+
+void RasterPipeline::runCoverage(int x, int y, int count, GPixel dst[], const uint8_t coverage[]) {
+    if (fNoop) return;
+
+    int i = 0;
+    while (i < count) {
+        // find the run of pixels that are fully covered, uncovered, or partly covered
+        uint8_t c = coverage[i];
+        bool solid = c == 0 || c == 255;
+        int start = i++;
+        if (solid) {
+            while (i < count && coverage[i] == c) i++;
+        }
+        else {
+            while (i < count && coverage[i] != 0 && coverage[i] != 255) i++;
+        }
+
+        if (c == 255) {
+            this->run(x + start, y, i - start, dst + start);
+        }
+        else if (!solid) {
+            // blend into a copy of the dst, then move the dst towards it by the coverage
+            GPixel blended[kChunkSize];
+            for (int offset = start; offset < i; offset += kChunkSize) {
+                int n = std::min(i - offset, (int)kChunkSize);
+                memcpy(blended, dst + offset, n * sizeof(GPixel));
+                this->run(x + offset, y, n, blended);
+                fLerpProc(blended, coverage + offset, dst + offset, n);
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef RasterPipeline_DEFINED
+#define RasterPipeline_DEFINED
+
+#include "include/GColor.h"
+#include "include/GPaint.h"
+#include "include/GShader.h"
+#include "BlendRows.h"
+
+/**
+ *  A shader that can make its colors as floats, so draws with it go through the highp
+ *  pipeline instead of being rounded to 8 bits before they are blended.
+ */
+class FloatShader : public GShader {
+public:
+    /**
+     *  Like shadeRow(), but writes premultiplied colors (r, g, b <= a, all in [0, 1]) into
+     *  row[0...count - 1]. Must give the same colors however a row is split up.
+     */
+    virtual void shadeRowF(int x, int y, int count, GColor row[]) = 0;
+
+    // rounds the float colors, for anyone calling through GShader
+    void shadeRow(int x, int y, int count, GPixel row[]) override;
+};
+
+/**
+ *  Shades & blends spans by running a list of stages over them, kChunkSize pixels at a time:
+ *
+ *      shade (or seed with the paint color) -> scale by paint alpha -> load dst -> blend -> store
+ *
+ *  The lowp backend keeps the pixels as premultiplied 8888 and does its math in 16-bit fixed
+ *  point, using the SIMD kernels from BlendRows.cpp (which load, blend & store in one pass).
+ *  The highp backend does every stage in float, and is used for FloatShaders.
+ *  The stages are picked once per draw from the paint, shader & blend mode.
+ */
+class RasterPipeline {
+public:
+    static const int kChunkSize = 64;
+
+    /**
+     *  src is the paint's color as a pixel. rowStorage must hold at least a device row of
+     *  pixels; shaders that can't be run in chunks shade whole rows into it.
+     */
+    RasterPipeline(const GPaint& paint, GBlendMode mode, GPixel src, GPixel rowStorage[]);
+
+    // true if this draw leaves the device unchanged (kDst)
+    bool isNoop() const { return fNoop; }
+
+    // true if the draw is the same color for every pixel (so spans can be merged)
+    bool isConstant() const { return fSource == kColor_Source; }
+
+    bool isHighp() const { return fHighp; }
+
+    // shade & blend pixels [x ... x + count - 1] on row y into dst[0...count - 1]
+    void run(int x, int y, int count, GPixel dst[]);
+
+    // same, but each pixel only changes by how much it's covered (coverage[i] / 255)
+    void runCoverage(int x, int y, int count, GPixel dst[], const uint8_t coverage[]);
+
+    // the registers that the stages read & write, defined in RasterPipeline.cpp
+    struct Chunk;
+    typedef void (*StageFn)(const RasterPipeline&, Chunk&);
+
+private:
+    // where the src pixels come from
+    enum Source {
+        kColor_Source,      // the paint color (lowp blends it without any per-chunk stages)
+        kShader_Source,     // shadeRow() for the whole span, then chunks of it
+        kBitmap_Source,     // BMShader, chunk by chunk
+        kFloat_Source,      // FloatShader, chunk by chunk (highp)
+    };
+
+    // what to do with a run of src pixels that are all opaque (or all transparent)
+    enum RunAction {
+        kBlend_RunAction,   // nothing special, blend them like any other pixels
+        kSkip_RunAction,    // the dst stays the same
+        kCopy_RunAction,    // the dst becomes the src
+    };
+
+    static const int kMaxStages = 8;
+
+    GShader* fShader;
+    GPixel* fRowStorage;
+    Source fSource;
+    bool fNoop;
+    bool fHighp;
+    // can the shader write right into the dst? (kSrc with nothing else to do)
+    bool fShadeIntoDst;
+
+    StageFn fStages[kMaxStages];
+    int fStageCount;
+
+    // context for the stages
+    GPixel fSrc;
+    GPixel fAlphaPixel;             // paint alpha, as the alpha of a pixel
+    float fAlpha;
+    BlendRowProc fRowProc;
+    BlendColorProc fColorProc;
+    BlendColorProc fScaleProc;
+    LerpRowProc fLerpProc;
+    RunAction fOpaqueRun;
+    RunAction fTransparentRun;
+
+    void append(StageFn fn) {
+        assert(fStageCount < kMaxStages);
+        fStages[fStageCount++] = fn;
+    }
+
+    void runStages(Chunk& chunk) const;
+
+    // the stage functions, defined in RasterPipeline.cpp
+    friend struct Stages;
+};
+
+#endif
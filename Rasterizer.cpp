@@ -0,0 +1,488 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "Rasterizer.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+// adds the edge a -> b (if it covers any rows), giving it the winding of the line it came from
+static int addEdge(GPoint a, GPoint b, int winding, Edge out[]) {
+    Edge edge(a, b);
+    if (edge.yTop == edge.yBottom) return 0;
+    edge.winding = winding;
+    out[0] = edge;
+    return 1;
+}
+
+int ClipLine(GPoint p0, GPoint p1, int width, int height, bool antiAlias, Edge out[]) {
+    // anti-aliased edges work in sub-rows
+    if (antiAlias) {
+        const float scale = 1 << kSuperSampleShift;
+        p0.fY *= scale;
+        p1.fY *= scale;
+        height <<= kSuperSampleShift;
+    }
+
+    if (p0.fY == p1.fY) return 0;
+
+    // go top to bottom, but remember which way the line went
+    int winding = 1;
+    if (p0.fY > p1.fY) {
+        std::swap(p0, p1);
+        winding = -1;
+    }
+
+    // discard if completely too high or low
+    if (p1.fY <= 0 || p0.fY >= height) return 0;
+
+    // clip top & bottom
+    float dxdy = (p1.fX - p0.fX) / (p1.fY - p0.fY);
+    if (p0.fY < 0) {
+        p0 = {p0.fX - p0.fY * dxdy, 0};
+    }
+    if (p1.fY > height) {
+        p1 = {p1.fX - (p1.fY - height) * dxdy, float(height)};
+    }
+
+    // now go left to right
+    GPoint left = p0;
+    GPoint right = p1;
+    if (left.fX > right.fX) std::swap(left, right);
+
+    // if completely too left or right, just make a projection
+    if (right.fX <= 0) {
+        return addEdge({0, p0.fY}, {0, p1.fY}, winding, out);
+    }
+    if (left.fX >= width) {
+        return addEdge({float(width), p0.fY}, {float(width), p1.fY}, winding, out);
+    }
+
+    // y where the line crosses x
+    float dydx = (right.fY - left.fY) / (right.fX - left.fX);
+    auto yAt = [&](float x) { return left.fY + (x - left.fX) * dydx; };
+
+    int count = 0;
+    // clip left, projecting the part past it onto the left side
+    if (left.fX < 0) {
+        GPoint hit = {0, yAt(0)};
+        count += addEdge({0, left.fY}, hit, winding, out + count);
+        left = hit;
+    }
+    // clip right, projecting the part past it onto the right side
+    if (right.fX > width) {
+        GPoint hit = {float(width), yAt(width)};
+        count += addEdge(hit, {float(width), right.fY}, winding, out + count);
+        right = hit;
+    }
+    count += addEdge(left, right, winding, out + count);
+    return count;
+}
+
+int LineEdge(GPoint p0, GPoint p1, bool antiAlias, Edge out[]) {
+    if (antiAlias) {
+        const float scale = 1 << kSuperSampleShift;
+        p0.fY *= scale;
+        p1.fY *= scale;
+    }
+
+    if (p0.fY == p1.fY) return 0;
+
+    int winding = 1;
+    if (p0.fY > p1.fY) {
+        std::swap(p0, p1);
+        winding = -1;
+    }
+    // left to right, the same as ClipLine() gives them to addEdge()
+    if (p0.fX > p1.fX) std::swap(p0, p1);
+    return addEdge(p0, p1, winding, out);
+}
+
+// sort by topY w/ leftmost X as tiebreaker
+static bool compareEdges(const Edge& e1, const Edge& e2) {
+    if (e1.yTop == e2.yTop) return (e1.xLeft < e2.xLeft);
+    return (e1.yTop < e2.yTop);
+}
+
+// new edges that join in a row are sorted & merged in (instead of inserted one by one) when
+// there are more than this many (which a long, dense path can have in every row)
+const int kMergeJoinCount = 16;
+
+// sort by x in the current row, with ties broken by everything else that tells edges apart,
+// so edges in the same place (like collinear pieces winding opposite ways) always come out in
+// the same order, whichever order they joined in (which clipping them can change) & whether
+// they were inserted or merged
+static bool compareX(const Edge* e1, const Edge* e2) {
+    if (e1->fixedX != e2->fixedX) return e1->fixedX < e2->fixedX;
+    if (e1->fixedDX != e2->fixedDX) return e1->fixedDX < e2->fixedDX;
+    if (e1->winding != e2->winding) return e1->winding < e2->winding;
+    return e1->yBottom < e2->yBottom;
+}
+
+// Walks the edges down the rows, calling span(y, left, right) for each span that's inside
+// (between the left & right edges' x in row y), for the rows in [yMin, yMax)
+template <typename SpanProc>
+static void walkEdges(Edge edges[], int count, GPathFillType fillType, int yMin, int yMax,
+                      Arena& arena, SpanProc&& span) {
+    std::sort(edges, edges + count, compareEdges);
+
+    // the active edges, kept sorted by their x in the current row (& room to merge into)
+    Edge** active = arena.makeArray<Edge*>(count);
+    Edge** merged = arena.makeArray<Edge*>(count);
+    int activeCount = 0;
+    int sortedCount = 0;    // active[0 ... sortedCount - 1] were in order in the last row
+    int next = 0;           // first edge that hasn't joined yet
+
+    int y = edges[0].yTop;
+    while (next < count || activeCount > 0) {
+        // nothing to draw until the next edge starts
+        if (activeCount == 0) y = std::max(y, edges[next].yTop);
+
+        // new edges join
+        while (next < count && edges[next].yTop == y) {
+            edges[next].startStepping(y);
+            active[activeCount++] = &edges[next++];
+        }
+        if (y >= yMax) break;
+
+        // jump down to yMin (or the next edge to join, if that's first)
+        if (y < yMin) {
+            int target = yMin;
+            if (next < count) target = std::min(target, edges[next].yTop);
+            int kept = 0, keptSorted = 0;
+            for (int i = 0; i < activeCount; i++) {
+                if (active[i]->yBottom > target) {
+                    active[i]->step(target - y);
+                    active[kept++] = active[i];
+                    if (i < sortedCount) keptSorted++;
+                }
+            }
+            activeCount = kept;
+            sortedCount = keptSorted;
+            y = target;
+            continue;
+        }
+
+        // insertion sort by x (the order of the edges from the last row only changes where
+        // edges cross, so this is cheap), with the edges that just joined merged in after if
+        // there are a lot of them
+        bool mergeJoined = activeCount - sortedCount > kMergeJoinCount;
+        int insertCount = mergeJoined ? sortedCount : activeCount;
+        for (int i = 1; i < insertCount; i++) {
+            Edge* e = active[i];
+            int j = i - 1;
+            for (; j >= 0 && compareX(e, active[j]); j--) {
+                active[j + 1] = active[j];
+            }
+            active[j + 1] = e;
+        }
+        if (mergeJoined) {
+            std::sort(active + sortedCount, active + activeCount, compareX);
+            std::merge(active, active + sortedCount, active + sortedCount, active + activeCount,
+                       merged, compareX);
+            std::swap(active, merged);
+        }
+
+        // walk left to right, accumulating the winding & drawing wherever it's inside
+        int w = 0;
+        bool inside = false;
+        const Edge* spanLeft = nullptr;
+        for (int i = 0; i < activeCount; i++) {
+            w += active[i]->winding;
+            bool nowInside = fillType == GPathFillType::kWinding ? w != 0 : (w & 1) != 0;
+            if (nowInside && !inside) spanLeft = active[i];
+            if (!nowInside && inside) span(y, *spanLeft, *active[i]);
+            inside = nowInside;
+        }
+
+        // edges that end in this row leave, the rest step down to the next one
+        y++;
+        int kept = 0;
+        for (int i = 0; i < activeCount; i++) {
+            if (active[i]->yBottom > y) {
+                active[i]->step();
+                active[kept++] = active[i];
+            }
+        }
+        activeCount = kept;
+        sortedCount = kept;
+    }
+}
+
+/**
+ *  Adds up how much of each pixel in a row the spans on its sub-rows cover, & blits the row
+ *  with that coverage once the spans move on to the next row.
+ */
+class CoverageRow {
+public:
+    CoverageRow(SpanBlitter& blitter, uint16_t sums[], uint8_t coverage[])
+        : fBlitter(blitter), fSums(sums), fCoverage(coverage), fY(-1),
+          fLeft(blitter.width()), fRight(0) {
+        fClipLeft = blitter.clip().fLeft << 16;
+        fClipRight = blitter.clip().fRight << 16;
+    }
+
+    // adds the span [left, right) (in 16.16 fixed point) on sub-row subY
+    void addSpan(int subY, int32_t left, int32_t right) {
+        int y = subY >> kSuperSampleShift;
+        if (y != fY) {
+            this->flush();
+            fY = y;
+        }
+
+        // pixels outside the clip aren't drawn, so don't bother adding them up
+        // (the ones inside get exactly the same sums either way)
+        left = std::max(left, fClipLeft);
+        right = std::min(right, fClipRight);
+        if (left >= right) return;
+
+        // each sub-row adds up to 256 / (sub-rows per row) to a pixel, scaled by how much
+        // of the pixel the span covers horizontally
+        const int kSubRowMax = 256 >> kSuperSampleShift;
+        int xL = left >> 16;
+        int xR = right >> 16;
+        if (xL == xR) {
+            fSums[xL] += ((right - left) * kSubRowMax) >> 16;
+        }
+        else {
+            fSums[xL] += ((0x10000 - (left & 0xFFFF)) * kSubRowMax) >> 16;
+            for (int x = xL + 1; x < xR; x++) {
+                fSums[x] += kSubRowMax;
+            }
+            if (right & 0xFFFF) fSums[xR] += ((right & 0xFFFF) * kSubRowMax) >> 16;
+        }
+        fLeft = std::min(fLeft, xL);
+        fRight = std::max(fRight, (right + 0xFFFF) >> 16);
+    }
+
+    // blits the row that has been added up so far, & starts over
+    void flush() {
+        if (fLeft < fRight) {
+            for (int x = fLeft; x < fRight; x++) {
+                fCoverage[x] = std::min((int)fSums[x], 255);
+                fSums[x] = 0;
+            }
+            fBlitter.blitAntiRow(fLeft, fY, fRight - fLeft, fCoverage + fLeft);
+        }
+        fLeft = fBlitter.width();
+        fRight = 0;
+    }
+
+private:
+    SpanBlitter& fBlitter;
+    uint16_t* fSums;        // width sums of coverage for the row, 0 when not in use
+    uint8_t* fCoverage;     // the sums, pinned to 255
+    int fY;
+    int fLeft, fRight;      // the pixels with sums are all in [fLeft, fRight)
+    int32_t fClipLeft, fClipRight;
+};
+
+void FillEdges(Edge edges[], int count, GPathFillType fillType, bool antiAlias,
+               SpanBlitter& blitter, Arena& arena) {
+    if (count < 2) return;
+
+    if (!antiAlias) {
+        const GIRect& clip = blitter.clip();
+        walkEdges(edges, count, fillType, clip.fTop, clip.fBottom, arena,
+                  [&](int y, const Edge& left, const Edge& right) {
+            int xL = left.currX();
+            int xR = right.currX();
+            if (xR > xL) blitter.blitRow(xL, y, xR - xL);
+        });
+        return;
+    }
+
+    // the rows are really sub-rows, so add up each row's spans before blitting it
+    int width = blitter.width();
+    uint16_t* sums = arena.makeArray<uint16_t>(width + 1);
+    uint8_t* coverage = arena.makeArray<uint8_t>(width);
+    memset(sums, 0, (width + 1) * sizeof(uint16_t));
+    CoverageRow row(blitter, sums, coverage);
+    const GIRect& clip = blitter.clip();
+    walkEdges(edges, count, fillType, clip.fTop << kSuperSampleShift,
+              clip.fBottom << kSuperSampleShift, arena,
+              [&](int subY, const Edge& left, const Edge& right) {
+        row.addSpan(subY, left.fixedX, right.fixedX);
+    });
+    row.flush();
+}
+
+// Tiny polygons below!
+
+// E(p) = a * p.x + b * p.y + c, which is > 0 inside the polygon (& 0 on the side).
+// Pixels whose centers are exactly on a side only count if it's a right or bottom side,
+// to match FillEdges (which covers centers in (left, right] & (top, bottom]).
+struct EdgeFunction {
+    float a, b, c;
+    bool inclusive;
+};
+
+// returns the bits (bit i for pixel x + i) of the 8 pixels in row y that are inside every edge
+static unsigned insideMask8(const EdgeFunction fns[], int count, float x, float y) {
+#if defined(__SSE2__)
+    const __m128 lanesLo = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 lanesHi = _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f);
+    const __m128 zero = _mm_setzero_ps();
+    unsigned mask = 0xFF;
+    for (int i = 0; i < count && mask != 0; i++) {
+        const EdgeFunction& f = fns[i];
+        __m128 a = _mm_set1_ps(f.a);
+        __m128 e = _mm_set1_ps(f.a * x + f.b * (y + 0.5f) + f.c);
+        __m128 eLo = _mm_add_ps(e, _mm_mul_ps(a, lanesLo));
+        __m128 eHi = _mm_add_ps(e, _mm_mul_ps(a, lanesHi));
+        __m128 inLo = _mm_cmpgt_ps(eLo, zero);
+        __m128 inHi = _mm_cmpgt_ps(eHi, zero);
+        if (f.inclusive) {
+            inLo = _mm_or_ps(inLo, _mm_cmpeq_ps(eLo, zero));
+            inHi = _mm_or_ps(inHi, _mm_cmpeq_ps(eHi, zero));
+        }
+        mask &= (unsigned)_mm_movemask_ps(inLo) | ((unsigned)_mm_movemask_ps(inHi) << 4);
+    }
+    return mask;
+#else
+    unsigned mask = 0;
+    for (int lane = 0; lane < 8; lane++) {
+        bool inside = true;
+        for (int i = 0; i < count && inside; i++) {
+            const EdgeFunction& f = fns[i];
+            float e = f.a * x + f.b * (y + 0.5f) + f.c + f.a * (lane + 0.5f);
+            inside = e > 0 || (f.inclusive && e == 0);
+        }
+        mask |= (unsigned)inside << lane;
+    }
+    return mask;
+#endif
+}
+
+void FillTinyConvex(const GPoint pts[], int count, SpanBlitter& blitter, Arena& arena) {
+    // work relative to the top-left of the bounds, so the edge functions stay small & exact
+    float minX = pts[0].fX, minY = pts[0].fY, maxX = minX, maxY = minY;
+    for (int i = 1; i < count; i++) {
+        minX = std::min(minX, pts[i].fX);
+        minY = std::min(minY, pts[i].fY);
+        maxX = std::max(maxX, pts[i].fX);
+        maxY = std::max(maxY, pts[i].fY);
+    }
+    const GIRect& clip = blitter.clip();
+    int left = std::max(GFloorToInt(minX), clip.fLeft);
+    int top = std::max(GFloorToInt(minY), clip.fTop);
+    int right = std::min(GCeilToInt(maxX), clip.fRight);
+    int bottom = std::min(GCeilToInt(maxY), clip.fBottom);
+    if (left >= right || top >= bottom) return;
+
+    // which way around the polygon goes (twice its signed area)
+    float area = 0;
+    for (int i = 0; i < count; i++) {
+        GPoint p0 = pts[i];
+        GPoint p1 = pts[(i + 1) % count];
+        area += (p0.fX - left) * (p1.fY - top) - (p1.fX - left) * (p0.fY - top);
+    }
+    if (area == 0) return;
+    float sign = area > 0 ? 1 : -1;
+
+    // set up an edge function for each side (skipping any that are just a point)
+    EdgeFunction* fns = arena.makeArray<EdgeFunction>(count);
+    int fnCount = 0;
+    for (int i = 0; i < count; i++) {
+        GPoint p0 = {pts[i].fX - left, pts[i].fY - top};
+        GPoint p1 = {pts[(i + 1) % count].fX - left, pts[(i + 1) % count].fY - top};
+        if (p0 == p1) continue;
+        EdgeFunction& f = fns[fnCount++];
+        f.a = sign * (p0.fY - p1.fY);
+        f.b = sign * (p1.fX - p0.fX);
+        f.c = -(f.a * p0.fX + f.b * p0.fY);
+        // the inside is to the left of a right side (a < 0) & above a bottom one (b < 0)
+        f.inclusive = f.a < 0 || (f.a == 0 && f.b < 0);
+    }
+
+    int width = right - left;
+    for (int y = top; y < bottom; y++) {
+        // find the first & last pixels inside (in between are too, since it's convex)
+        int first = -1;
+        int last = -1;
+        for (int x = 0; x < width; x += 8) {
+            unsigned mask = insideMask8(fns, fnCount, x, y - top);
+            if (width - x < 8) mask &= (1u << (width - x)) - 1;
+            if (mask == 0) continue;
+            if (first < 0) first = x + __builtin_ctz(mask);
+            last = x + 31 - __builtin_clz(mask);
+        }
+        if (first >= 0) blitter.blitRow(left + first, y, last - first + 1);
+    }
+}
+
+// Round rects below!
+
+// the shape of a round rect, to find how wide it is at any y
+struct RRectShape {
+    float centerX, centerY;
+    float halfWidth, halfHeight;
+    float rx, ry;
+
+    // x of the left & right sides at y, or false if y is above or below it (like edges,
+    // which count y's in (top, bottom])
+    bool sides(float y, float* left, float* right) const {
+        float dy = fabsf(y - centerY);
+        if (!(y > centerY - halfHeight && y <= centerY + halfHeight)) return false;
+
+        // past the straight part of the sides, it's on a corner's ellipse:
+        // (dx / rx)^2 + (dy / ry)^2 = 1
+        float halfSpan = halfWidth;
+        float cornerDy = dy - (halfHeight - ry);
+        if (cornerDy > 0) {
+            float e = std::min(cornerDy / ry, 1.0f);
+            halfSpan += rx * (sqrtf(1 - e * e) - 1);
+        }
+        *left = centerX - halfSpan;
+        *right = centerX + halfSpan;
+        return true;
+    }
+};
+
+void FillRRect(const GRect& rect, float rx, float ry, bool antiAlias, SpanBlitter& blitter,
+               Arena& arena) {
+    const GIRect& clip = blitter.clip();
+    RRectShape shape = {(rect.fLeft + rect.fRight) / 2, (rect.fTop + rect.fBottom) / 2,
+                        rect.width() / 2, rect.height() / 2, rx, ry};
+    int top = std::max(GFloorToInt(rect.fTop), clip.fTop);
+    int bottom = std::min(GCeilToInt(rect.fBottom), clip.fBottom);
+    float clipLeft = clip.fLeft;
+    float clipRight = clip.fRight;
+
+    if (!antiAlias) {
+        // pixels whose centers are inside, on rows whose centers are
+        for (int y = top; y < bottom; y++) {
+            float left, right;
+            if (!shape.sides(y + 0.5f, &left, &right)) continue;
+            int xL = GRoundToInt(std::max(left, clipLeft));
+            int xR = GRoundToInt(std::min(right, clipRight));
+            if (xR > xL) blitter.blitRow(xL, y, xR - xL);
+        }
+        return;
+    }
+
+    // the same sub-rows as FillEdges, with the exact x of each side
+    int width = blitter.width();
+    uint16_t* sums = arena.makeArray<uint16_t>(width + 1);
+    uint8_t* coverage = arena.makeArray<uint8_t>(width);
+    memset(sums, 0, (width + 1) * sizeof(uint16_t));
+    CoverageRow row(blitter, sums, coverage);
+    const int subRows = 1 << kSuperSampleShift;
+    for (int y = top; y < bottom; y++) {
+        for (int sub = 0; sub < subRows; sub++) {
+            float left, right;
+            if (!shape.sides(y + (sub + 0.5f) / subRows, &left, &right)) continue;
+            left = std::max(left, clipLeft);
+            right = std::min(right, clipRight);
+            if (left < right) {
+                row.addSpan((y << kSuperSampleShift) + sub, (int32_t)(left * 65536),
+                            (int32_t)(right * 65536));
+            }
+        }
+    }
+    row.flush();
+}
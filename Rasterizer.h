@@ -0,0 +1,74 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef Rasterizer_DEFINED
+#define Rasterizer_DEFINED
+
+#include "include/GPath.h"
+#include "include/GPoint.h"
+#include "Arena.h"
+#include "Blitter.h"
+#include "Edge.h"
+
+// when anti-aliasing, each row of pixels is scan converted as (1 << kSuperSampleShift) sub-rows
+const int kSuperSampleShift = 2;
+
+// curves are filled as lines that are no more than this many pixels away from them
+const float kCurveTolerance = 0.25f;
+
+/**
+ *  Clips the line p0 -> p1 to a width x height device, writing up to 3 edges into out[] &
+ *  returning how many it wrote. Parts of the line past the left or right side are projected
+ *  onto that side (with the line's winding), so fills of the clipped edges still come out
+ *  right. Edges that don't cross the center of any row are dropped.
+ *
+ *  If antiAlias is true, the edges' rows are sub-rows (for FillEdges to anti-alias).
+ */
+int ClipLine(GPoint p0, GPoint p1, int width, int height, bool antiAlias, Edge out[]);
+
+/**
+ *  Same as ClipLine(), for a line that's already inside the device (so there's nothing to
+ *  clip): writes the line's edge into out[] (if it crosses any row centers) & returns 0 or 1.
+ */
+int LineEdge(GPoint p0, GPoint p1, bool antiAlias, Edge out[]);
+
+/**
+ *  Fills the area inside the (already clipped) edges, deciding what's inside with fillType.
+ *
+ *  This is an active edge table: edges join the table in the row they start, step down one
+ *  row at a time in fixed point & leave after their last row, & every row's spans go straight
+ *  to the blitter. Reorders edges[], & gets its scratch memory from arena.
+ *
+ *  With antiAlias, the spans on each row's sub-rows are added up into how much of each pixel
+ *  is covered (keeping the exact x of each edge, not rounding it), & the row is blitted with
+ *  that coverage.
+ */
+void FillEdges(Edge edges[], int count, GPathFillType fillType, bool antiAlias,
+               SpanBlitter& blitter, Arena& arena);
+
+// convex polygons with at most kTinyMaxPoints points whose bounds fit in a
+// kTinySize x kTinySize box go to FillTinyConvex() (with more sides, testing every pixel
+// against every side costs more than scan converting)
+const int kTinySize = 16;
+const int kTinyMaxPoints = 8;
+
+/**
+ *  Fills a small convex polygon (not clipped yet) by testing the center of each pixel in its
+ *  bounds against the edge functions of its sides, 8 pixels at a time, instead of building,
+ *  sorting & walking edges. Covers the same pixels as ClipLine() + FillEdges(), except maybe
+ *  for centers that land exactly on a side. Gets its scratch memory from arena.
+ */
+void FillTinyConvex(const GPoint pts[], int count, SpanBlitter& blitter, Arena& arena);
+
+/**
+ *  Fills the round rect inside rect (in device space, with left <= right & top <= bottom),
+ *  whose corners are quarters of the ellipse with radii rx & ry (0 < rx <= width / 2, 0 < ry <=
+ *  height / 2), by solving for the span of each row (or sub-row, when anti-aliasing) directly
+ *  instead of building edges. Only the rows & pixels inside blitter.clip() are sent. Gets its
+ *  scratch memory from arena.
+ */
+void FillRRect(const GRect& rect, float rx, float ry, bool antiAlias, SpanBlitter& blitter,
+               Arena& arena);
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "SampleRows.h"
+#include "CPULevel.h"
+#include <cmath>
+
+// like BlendRows.cpp, every SIMD version is compiled inside a target pragma & picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SAMPLE_ROWS_X86
+    #include <immintrin.h>
+#endif
+
+// the float math has to round the same way at every level, so none of it may be fused into
+// multiply-adds (AVX-512 has them, & GCC fuses C++ even with -std=c++11)
+#if defined(__clang__)
+    #pragma clang fp contract(off)
+#elif defined(__GNUC__)
+    #pragma GCC optimize("fp-contract=off")
+#endif
+
+// The filters weigh the pixels around a point by how far it is past the center of the pixel
+// to its left (& above), in 1 / (1 << bits)ths of a pixel. Bilinear's 4-bit fractions keep
+// every weight (& every channel * weight sum) in 16 bits; bicubic's pick a row of its table.
+static const int kBilinearBits = 4;
+static const int kBicubicBits = 8;
+
+/**
+ *  Splits local coord v into the pixel whose center is at or left of it (pinned to
+ *  [-1, size]) & how far past that center it is, as one fixed point number:
+ *  (index << bits) + fraction. Pinning first keeps it in an int (& puts NaN on -1); the
+ *  pixels around it get pinned to the bitmap after.
+ */
+static inline int FilterFixed(float v, int size, int bits) {
+    float u = v - 0.5f;
+    u = !(u > -1) ? -1 : u < size ? u : size;
+    return (int)((u + 1) * (1 << bits)) - (1 << bits);
+}
+
+static inline int PinIndex(int i, int size) {
+    return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+/**
+ *  Mitchell-Netravali (B = C = 1/3) weights for the 4 pixels around a point, for each
+ *  fraction of the way it is from the 2nd one's center to the 3rd's. They're in 1/16384ths,
+ *  & each set adds up to exactly 16384 (so flat colors & opaque bitmaps stay the same).
+ *
+ *  pairs has the same weights packed (w0, w1) & (w2, w3) into 32-bit ints, low half first,
+ *  which is how madd wants them.
+ */
+struct BicubicWeights {
+    int16_t w[1 << kBicubicBits][4];
+    uint32_t pairs[1 << kBicubicBits][2];
+};
+
+static float Mitchell(float d) {
+    const float B = 1 / 3.0f, C = 1 / 3.0f;
+    d = fabsf(d);
+    if (d < 1) {
+        return ((12 - 9 * B - 6 * C) * d * d * d + (-18 + 12 * B + 6 * C) * d * d
+                + (6 - 2 * B)) / 6;
+    }
+    if (d < 2) {
+        return ((-B - 6 * C) * d * d * d + (6 * B + 30 * C) * d * d + (-12 * B - 48 * C) * d
+                + (8 * B + 24 * C)) / 6;
+    }
+    return 0;
+}
+
+static const BicubicWeights& GetBicubicWeights() {
+    static const BicubicWeights weights = []() {
+        BicubicWeights table;
+        for (int i = 0; i < (1 << kBicubicBits); i++) {
+            float t = (float)i / (1 << kBicubicBits);
+            int16_t* w = table.w[i];
+            w[0] = lrintf(Mitchell(1 + t) * 16384);
+            w[1] = lrintf(Mitchell(t) * 16384);
+            w[2] = lrintf(Mitchell(1 - t) * 16384);
+            w[3] = 16384 - w[0] - w[1] - w[2];
+            table.pairs[i][0] = (uint16_t)w[0] | ((uint32_t)(uint16_t)w[1] << 16);
+            table.pairs[i][1] = (uint16_t)w[2] | ((uint32_t)(uint16_t)w[3] << 16);
+        }
+        return table;
+    }();
+    return weights;
+}
+
+namespace scalar {
+
+static void sampleRow(const GBitmap& bitmap, GPoint start, GPoint step, int x, int count,
+                      GPixel row[]) {
+    for (int i = 0; i < count; i++) {
+        float localX = start.fX + step.fX * (x + i);
+        float localY = start.fY + step.fY * (x + i);
+        row[i] = *bitmap.getAddr(SampleIndex(localX, bitmap.width()),
+                                 SampleIndex(localY, bitmap.height()));
+    }
+}
+
+// (c00 * w00 + c10 * w10 + c01 * w01 + c11 * w11 + 128) >> 8 for each channel, where the
+// weights come from the fractions fx & fy & add up to 256
+static inline GPixel bilerp(GPixel p00, GPixel p10, GPixel p01, GPixel p11, int fx, int fy) {
+    const int one = 1 << kBilinearBits;
+    unsigned w00 = (one - fx) * (one - fy), w10 = fx * (one - fy);
+    unsigned w01 = (one - fx) * fy, w11 = fx * fy;
+    GPixel result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        unsigned c = ((p00 >> shift) & 0xFF) * w00 + ((p10 >> shift) & 0xFF) * w10
+                   + ((p01 >> shift) & 0xFF) * w01 + ((p11 >> shift) & 0xFF) * w11;
+        result |= ((c + 128) >> 8) << shift;
+    }
+    return result;
+}
+
+static void bilinearRow(const GBitmap& bitmap, GPoint start, GPoint step, int x, int count,
+                        GPixel row[]) {
+    const int width = bitmap.width(), height = bitmap.height();
+    const int mask = (1 << kBilinearBits) - 1;
+    for (int i = 0; i < count; i++) {
+        int fixedX = FilterFixed(start.fX + step.fX * (x + i), width, kBilinearBits);
+        int fixedY = FilterFixed(start.fY + step.fY * (x + i), height, kBilinearBits);
+        int x0 = fixedX >> kBilinearBits, y0 = fixedY >> kBilinearBits;
+
+        const GPixel* top = bitmap.getAddr(0, PinIndex(y0, height));
+        const GPixel* bottom = bitmap.getAddr(0, PinIndex(y0 + 1, height));
+        int left = PinIndex(x0, width), right = PinIndex(x0 + 1, width);
+        row[i] = bilerp(top[left], top[right], bottom[left], bottom[right],
+                        fixedX & mask, fixedY & mask);
+    }
+}
+
+// each row's 4 pixels are weighed by wx (rounded back to whole channels), then the 4 rows
+// by wy; the curve can overshoot, so the result is pinned to [0, 255] & the colors to alpha
+static inline GPixel bicubic(const GPixel* const rows[4], const int xs[4],
+                             const int16_t wx[4], const int16_t wy[4]) {
+    int sums[4] = {0, 0, 0, 0};
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            int h = 0;
+            for (int k = 0; k < 4; k++) {
+                h += (int)((rows[r][xs[k]] >> (c * 8)) & 0xFF) * wx[k];
+            }
+            sums[c] += ((h + (1 << 13)) >> 14) * wy[r];
+        }
+    }
+
+    unsigned channels[4];
+    for (int c = 0; c < 4; c++) {
+        int v = (sums[c] + (1 << 13)) >> 14;
+        channels[c] = v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+    unsigned a = channels[GPIXEL_SHIFT_A / 8];
+    GPixel result = 0;
+    for (int c = 0; c < 4; c++) {
+        result |= std::min(channels[c], a) << (c * 8);
+    }
+    return result;
+}
+
+static void bicubicRow(const GBitmap& bitmap, GPoint start, GPoint step, int x, int count,
+                       GPixel row[]) {
+    const BicubicWeights& table = GetBicubicWeights();
+    const int width = bitmap.width(), height = bitmap.height();
+    const int mask = (1 << kBicubicBits) - 1;
+    for (int i = 0; i < count; i++) {
+        int fixedX = FilterFixed(start.fX + step.fX * (x + i), width, kBicubicBits);
+        int fixedY = FilterFixed(start.fY + step.fY * (x + i), height, kBicubicBits);
+        int left = (fixedX >> kBicubicBits) - 1, top = (fixedY >> kBicubicBits) - 1;
+
+        const GPixel* rows[4];
+        int xs[4];
+        for (int k = 0; k < 4; k++) {
+            rows[k] = bitmap.getAddr(0, PinIndex(top + k, height));
+            xs[k] = PinIndex(left + k, width);
+        }
+        row[i] = bicubic(rows, xs, table.w[fixedX & mask], table.w[fixedY & mask]);
+    }
+}
+
+}   // namespace scalar
+
+// SSE2: 4 points at a time (no gather, so the pixels are loaded one by one)
+
+#if defined(SAMPLE_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("sse2")
+#endif
+namespace sse2 {
+
+typedef __m128 F;
+typedef __m128i I;
+static const int N = 4;
+
+static inline F splat(float f) { return _mm_set1_ps(f); }
+static inline F iota(int x) {
+    return _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3)));
+}
+static inline F add(F a, F b) { return _mm_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+static inline F pin(F v, F lo, F hi) { return _mm_min_ps(_mm_max_ps(v, lo), hi); }
+static inline I trunc(F v) { return _mm_cvttps_epi32(v); }
+
+static inline I splatI(int i) { return _mm_set1_epi32(i); }
+static inline I addI(I a, I b) { return _mm_add_epi32(a, b); }
+static inline I subI(I a, I b) { return _mm_sub_epi32(a, b); }
+static inline I andI(I a, I b) { return _mm_and_si128(a, b); }
+static inline I shiftRightI(I v, int bits) { return _mm_srai_epi32(v, bits); }
+static inline I pinI(I v, I max) {
+    // (no 32-bit min & max until SSE4.1)
+    v = _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_setzero_si128()));
+    I over = _mm_cmpgt_epi32(v, max);
+    return _mm_or_si128(_mm_and_si128(over, max), _mm_andnot_si128(over, v));
+}
+
+static inline I gather(const GPixel* pixels, int stride, I ix, I iy) {
+    int32_t xs[N], ys[N];
+    _mm_storeu_si128((__m128i*)xs, ix);
+    _mm_storeu_si128((__m128i*)ys, iy);
+    return _mm_setr_epi32(pixels[ys[0] * stride + xs[0]], pixels[ys[1] * stride + xs[1]],
+                          pixels[ys[2] * stride + xs[2]], pixels[ys[3] * stride + xs[3]]);
+}
+static inline void store(GPixel* p, I v) { _mm_storeu_si128((__m128i*)p, v); }
+
+static inline I lo(I v) { return _mm_unpacklo_epi8(v, _mm_setzero_si128()); }
+static inline I hi(I v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+static inline I pack(I l, I h) { return _mm_packus_epi16(l, h); }
+static inline I add16(I a, I b) { return _mm_add_epi16(a, b); }
+static inline I mul16(I a, I b) { return _mm_mullo_epi16(a, b); }
+static inline I div256(I v) {
+    return _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(128)), 8);
+}
+static inline I spreadLo(I w) {
+    w = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+    return _mm_unpacklo_epi32(w, w);
+}
+static inline I spreadHi(I w) {
+    w = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+    return _mm_unpackhi_epi32(w, w);
+}
+
+static inline I zip8Lo(I a, I b) { return _mm_unpacklo_epi8(a, b); }
+static inline I zip8Hi(I a, I b) { return _mm_unpackhi_epi8(a, b); }
+static inline I zip16Lo(I a, I b) { return _mm_unpacklo_epi16(a, b); }
+static inline I zip16Hi(I a, I b) { return _mm_unpackhi_epi16(a, b); }
+static inline I madd(I a, I b) { return _mm_madd_epi16(a, b); }
+static inline I packs(I a, I b) { return _mm_packs_epi32(a, b); }
+template <int j> static inline I broadcast(I v) {
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(j, j, j, j));
+}
+static inline I alpha8(I v) {
+    I a = _mm_srli_epi32(v, GPIXEL_SHIFT_A);
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+    return _mm_or_si128(a, _mm_slli_epi32(a, 16));
+}
+static inline I min8(I a, I b) { return _mm_min_epu8(a, b); }
+
+#include "SampleRows.inc"
+
+}   // namespace sse2
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+// AVX2: 8 points at a time, gathered with vpgatherdd
+// (unpack & pack both work within each 128-bit half, so the pixels stay in order)
+
+#if defined(SAMPLE_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+#endif
+namespace avx2 {
+
+typedef __m256 F;
+typedef __m256i I;
+static const int N = 8;
+
+static inline F splat(float f) { return _mm256_set1_ps(f); }
+static inline F iota(int x) {
+    I lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), lanes));
+}
+static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+static inline F pin(F v, F lo, F hi) { return _mm256_min_ps(_mm256_max_ps(v, lo), hi); }
+static inline I trunc(F v) { return _mm256_cvttps_epi32(v); }
+
+static inline I splatI(int i) { return _mm256_set1_epi32(i); }
+static inline I addI(I a, I b) { return _mm256_add_epi32(a, b); }
+static inline I subI(I a, I b) { return _mm256_sub_epi32(a, b); }
+static inline I andI(I a, I b) { return _mm256_and_si256(a, b); }
+static inline I shiftRightI(I v, int bits) { return _mm256_srai_epi32(v, bits); }
+static inline I pinI(I v, I max) {
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), max);
+}
+
+static inline I gather(const GPixel* pixels, int stride, I ix, I iy) {
+    I offsets = _mm256_add_epi32(_mm256_mullo_epi32(iy, _mm256_set1_epi32(stride)), ix);
+    return _mm256_i32gather_epi32((const int*)pixels, offsets, 4);
+}
+static inline void store(GPixel* p, I v) { _mm256_storeu_si256((__m256i*)p, v); }
+
+static inline I lo(I v) { return _mm256_unpacklo_epi8(v, _mm256_setzero_si256()); }
+static inline I hi(I v) { return _mm256_unpackhi_epi8(v, _mm256_setzero_si256()); }
+static inline I pack(I l, I h) { return _mm256_packus_epi16(l, h); }
+static inline I add16(I a, I b) { return _mm256_add_epi16(a, b); }
+static inline I mul16(I a, I b) { return _mm256_mullo_epi16(a, b); }
+static inline I div256(I v) {
+    return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(128)), 8);
+}
+static inline I spreadLo(I w) {
+    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+    return _mm256_unpacklo_epi32(w, w);
+}
+static inline I spreadHi(I w) {
+    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+    return _mm256_unpackhi_epi32(w, w);
+}
+
+static inline I zip8Lo(I a, I b) { return _mm256_unpacklo_epi8(a, b); }
+static inline I zip8Hi(I a, I b) { return _mm256_unpackhi_epi8(a, b); }
+static inline I zip16Lo(I a, I b) { return _mm256_unpacklo_epi16(a, b); }
+static inline I zip16Hi(I a, I b) { return _mm256_unpackhi_epi16(a, b); }
+static inline I madd(I a, I b) { return _mm256_madd_epi16(a, b); }
+static inline I packs(I a, I b) { return _mm256_packs_epi32(a, b); }
+template <int j> static inline I broadcast(I v) {
+    return _mm256_shuffle_epi32(v, _MM_SHUFFLE(j, j, j, j));
+}
+static inline I alpha8(I v) {
+    return _mm256_mullo_epi32(_mm256_srli_epi32(v, GPIXEL_SHIFT_A), _mm256_set1_epi32(0x01010101));
+}
+static inline I min8(I a, I b) { return _mm256_min_epu8(a, b); }
+
+#include "SampleRows.inc"
+
+}   // namespace avx2
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+// AVX-512: 16 points at a time, gathered with vpgatherdd
+
+#if defined(SAMPLE_ROWS_X86)
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx512f,avx512bw")
+#endif
+namespace avx512 {
+
+typedef __m512 F;
+typedef __m512i I;
+static const int N = 16;
+
+static inline F splat(float f) { return _mm512_set1_ps(f); }
+static inline F iota(int x) {
+    I lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(x), lanes));
+}
+static inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+static inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+static inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+static inline F pin(F v, F lo, F hi) { return _mm512_min_ps(_mm512_max_ps(v, lo), hi); }
+static inline I trunc(F v) { return _mm512_cvttps_epi32(v); }
+
+static inline I splatI(int i) { return _mm512_set1_epi32(i); }
+static inline I addI(I a, I b) { return _mm512_add_epi32(a, b); }
+static inline I subI(I a, I b) { return _mm512_sub_epi32(a, b); }
+static inline I andI(I a, I b) { return _mm512_and_si512(a, b); }
+static inline I shiftRightI(I v, int bits) { return _mm512_srai_epi32(v, bits); }
+static inline I pinI(I v, I max) {
+    return _mm512_min_epi32(_mm512_max_epi32(v, _mm512_setzero_si512()), max);
+}
+
+static inline I gather(const GPixel* pixels, int stride, I ix, I iy) {
+    I offsets = _mm512_add_epi32(_mm512_mullo_epi32(iy, _mm512_set1_epi32(stride)), ix);
+    return _mm512_i32gather_epi32(offsets, (const int*)pixels, 4);
+}
+static inline void store(GPixel* p, I v) { _mm512_storeu_si512((void*)p, v); }
+
+static inline I lo(I v) { return _mm512_unpacklo_epi8(v, _mm512_setzero_si512()); }
+static inline I hi(I v) { return _mm512_unpackhi_epi8(v, _mm512_setzero_si512()); }
+static inline I pack(I l, I h) { return _mm512_packus_epi16(l, h); }
+static inline I add16(I a, I b) { return _mm512_add_epi16(a, b); }
+static inline I mul16(I a, I b) { return _mm512_mullo_epi16(a, b); }
+static inline I div256(I v) {
+    return _mm512_srli_epi16(_mm512_add_epi16(v, _mm512_set1_epi16(128)), 8);
+}
+static inline I spreadLo(I w) {
+    w = _mm512_or_si512(w, _mm512_slli_epi32(w, 16));
+    return _mm512_unpacklo_epi32(w, w);
+}
+static inline I spreadHi(I w) {
+    w = _mm512_or_si512(w, _mm512_slli_epi32(w, 16));
+    return _mm512_unpackhi_epi32(w, w);
+}
+
+static inline I zip8Lo(I a, I b) { return _mm512_unpacklo_epi8(a, b); }
+static inline I zip8Hi(I a, I b) { return _mm512_unpackhi_epi8(a, b); }
+static inline I zip16Lo(I a, I b) { return _mm512_unpacklo_epi16(a, b); }
+static inline I zip16Hi(I a, I b) { return _mm512_unpackhi_epi16(a, b); }
+static inline I madd(I a, I b) { return _mm512_madd_epi16(a, b); }
+static inline I packs(I a, I b) { return _mm512_packs_epi32(a, b); }
+template <int j> static inline I broadcast(I v) {
+    return _mm512_shuffle_epi32(v, (_MM_PERM_ENUM)_MM_SHUFFLE(j, j, j, j));
+}
+static inline I alpha8(I v) {
+    return _mm512_mullo_epi32(_mm512_srli_epi32(v, GPIXEL_SHIFT_A), _mm512_set1_epi32(0x01010101));
+}
+static inline I min8(I a, I b) { return _mm512_min_epu8(a, b); }
+
+#include "SampleRows.inc"
+
+}   // namespace avx512
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+SampleRowProc GetSampleRowProc(GFilterQuality quality) {
+#if defined(SAMPLE_ROWS_X86)
+    CPULevel level = GetCPULevel();
+    switch (quality) {
+        case GFilterQuality::kNearest:
+            switch (level) {
+                case CPULevel::kAVX512: return avx512::sampleRow;
+                case CPULevel::kAVX2:   return avx2::sampleRow;
+                case CPULevel::kSSE2:   return sse2::sampleRow;
+                case CPULevel::kScalar: break;
+            }
+            break;
+        case GFilterQuality::kBilinear:
+            switch (level) {
+                case CPULevel::kAVX512: return avx512::bilinearRow;
+                case CPULevel::kAVX2:   return avx2::bilinearRow;
+                case CPULevel::kSSE2:   return sse2::bilinearRow;
+                case CPULevel::kScalar: break;
+            }
+            break;
+        case GFilterQuality::kBicubic:
+            switch (level) {
+                case CPULevel::kAVX512: return avx512::bicubicRow;
+                case CPULevel::kAVX2:   return avx2::bicubicRow;
+                case CPULevel::kSSE2:   return sse2::bicubicRow;
+                case CPULevel::kScalar: break;
+            }
+            break;
+    }
+#endif
+    switch (quality) {
+        case GFilterQuality::kNearest:  return scalar::sampleRow;
+        case GFilterQuality::kBilinear: return scalar::bilinearRow;
+        case GFilterQuality::kBicubic:  return scalar::bicubicRow;
+    }
+    return scalar::sampleRow;
+}
@@ -0,0 +1,40 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef SampleRows_DEFINED
+#define SampleRows_DEFINED
+
+#include "include/GBitmap.h"
+#include "include/GPoint.h"
+#include "include/GShader.h"
+
+/**
+ *  Samples the bitmap under a row of device pixels: the center of pixel [x + i, y] is at
+ *  (start.fX + step.fX * (x + i), start.fY + step.fY * (x + i)) in the bitmap, where start is
+ *  where the center of pixel [0, y] lands. The color there (from the pixels around it, pinned
+ *  to the edge pixels outside of the bitmap) is written to row[i].
+ *
+ *  Every point is worked out from its own x (never stepped from the one before it), so a
+ *  span gets the same pixels however it's split up.
+ */
+typedef void (*SampleRowProc)(const GBitmap& bitmap, GPoint start, GPoint step, int x,
+                              int count, GPixel row[]);
+
+/**
+ *  The index of the pixel that local coord v is inside, along a side of the bitmap with size
+ *  pixels, pinned to [0, size - 1]. Same as floor(v) pinned after, but v is pinned first so
+ *  points too far away to fit in an int still land on the edge they're past (& NaN on 0).
+ */
+static inline int SampleIndex(float v, int size) {
+    return !(v > 0) ? 0 : v >= size - 1 ? size - 1 : (int)v;
+}
+
+/**
+ *  Look up the sample row proc for a filter quality, for GetCPULevel() (bit-exact across the
+ *  levels). The filters work on premultiplied pixels & give premultiplied pixels back, &
+ *  filtering an opaque bitmap only gives opaque pixels.
+ */
+SampleRowProc GetSampleRowProc(GFilterQuality quality);
+
+#endif
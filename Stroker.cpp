@@ -0,0 +1,289 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "Stroker.h"
+#include "include/GCanvas.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// round joins & caps are polygons whose sides are at most this far (in pixels) from the circle
+// (& curves are flattened into lines that are at most this far from them)
+static const float kRoundTolerance = 0.25f;
+
+// the points on a round join or cap never get more than this many sides
+static const int kMaxArcSegments = 256;
+
+// v turned a quarter turn (keeping its length)
+static GPoint Perp(GPoint v) {
+    return {-v.fY, v.fX};
+}
+
+static float Cross(GPoint a, GPoint b) {
+    return a.fX * b.fY - a.fY * b.fX;
+}
+
+static float Dot(GPoint a, GPoint b) {
+    return a.fX * b.fX + a.fY * b.fY;
+}
+
+// the most the matrix stretches anything
+static float MaxScale(const GMatrix& ctm) {
+    float scaleX = sqrtf(ctm[0] * ctm[0] + ctm[3] * ctm[3]);
+    float scaleY = sqrtf(ctm[1] * ctm[1] + ctm[4] * ctm[4]);
+    return std::max(scaleX, scaleY);
+}
+
+/**
+ *  Strokes the contours of one path into another. Every piece is added going around the same
+ *  way as the rectangle of a line a -> b does (a + n, b + n, b - n, a - n, for the normal n).
+ */
+class Stroker {
+public:
+    Stroker(const GPaint& paint, const GMatrix& ctm, GPath* dst)
+        : fRadius(paint.getStrokeWidth() / 2), fJoin(paint.getStrokeJoin()),
+          fCap(paint.getStrokeCap()), fMiterLimit(paint.getMiterLimit()), fDst(dst) {
+        // how big circles get on the device
+        float deviceRadius = fRadius * MaxScale(ctm);
+
+        // the angle each side of a round join or cap can turn through while staying close
+        // enough to the circle
+        fArcStep = deviceRadius > kRoundTolerance
+                ? 2 * acosf(1 - kRoundTolerance / deviceRadius)
+                : (float)M_PI / 2;
+    }
+
+    void strokeContour(const GPoint src[], int count) {
+        // consecutive points on top of each other don't make lines
+        fPts.clear();
+        for (int i = 0; i < count; i++) {
+            if (fPts.empty() || src[i] != fPts.back()) fPts.push_back(src[i]);
+        }
+        int n = (int)fPts.size();
+        if (n == 0 || !(fRadius > 0)) return;
+
+        if (n == 1) {
+            this->dot(fPts[0]);
+            return;
+        }
+
+        bool closed = n >= 3 && fPts[n - 1] == fPts[0];
+        if (closed) n--;
+
+        // the direction of each line
+        int lineCount = closed ? n : n - 1;
+        fDirs.resize(lineCount);
+        for (int i = 0; i < lineCount; i++) {
+            GPoint d = fPts[(i + 1) % n] - fPts[i];
+            fDirs[i] = d * (1 / d.length());
+        }
+
+        for (int i = 0; i < lineCount; i++) {
+            this->line(fPts[i], fPts[(i + 1) % n], fDirs[i]);
+        }
+        for (int i = 1; i < lineCount; i++) {
+            this->join(fPts[i], fDirs[i - 1], fDirs[i]);
+        }
+        if (closed) {
+            this->join(fPts[0], fDirs[lineCount - 1], fDirs[0]);
+        } else {
+            this->cap(fPts[0], fDirs[0] * -1);
+            this->cap(fPts[n - 1], fDirs[lineCount - 1]);
+        }
+    }
+
+private:
+    const float fRadius;
+    const GStrokeJoin fJoin;
+    const GStrokeCap fCap;
+    const float fMiterLimit;
+    GPath* fDst;
+    float fArcStep;
+
+    // scratch space, kept between contours
+    std::vector<GPoint> fPts;
+    std::vector<GPoint> fDirs;
+    std::vector<GPoint> fPiece;
+
+    // the rectangle around the line a -> b (going in the unit direction dir)
+    void line(GPoint a, GPoint b, GPoint dir) {
+        GPoint n = Perp(dir) * fRadius;
+        fDst->moveTo(a + n).lineTo(b + n).lineTo(b - n).lineTo(a - n);
+    }
+
+    // fills in the corner between the lines going in unit directions d0 & then d1 through p
+    void join(GPoint p, GPoint d0, GPoint d1) {
+        float cross = Cross(d0, d1);
+        if (cross == 0 && Dot(d0, d1) > 0) return;
+
+        // the corner sticks out on the side away from the way the lines turn
+        float side = cross > 0 ? -fRadius : fRadius;
+        GPoint n0 = Perp(d0) * side;
+        GPoint n1 = Perp(d1) * side;
+
+        fPiece.clear();
+        fPiece.push_back(p);
+        fPiece.push_back(p + n0);
+        switch (fJoin) {
+            case GStrokeJoin::kMiter: {
+                // the point is out along the middle of the normals, 1 / cos(half the turn)
+                // radii away (which is 2 / |n0 + n1| in radii)
+                GPoint mid = (n0 + n1) * (1 / fRadius);
+                float midLength = mid.length();
+                if (midLength > 0 && 2 / midLength <= fMiterLimit) {
+                    fPiece.push_back(p + mid * (2 * fRadius / (midLength * midLength)));
+                }
+                break;
+            }
+            case GStrokeJoin::kRound:
+                this->arc(p, n0, atan2f(Cross(n0, n1), Dot(n0, n1)), false);
+                break;
+            case GStrokeJoin::kBevel:
+                break;
+        }
+        fPiece.push_back(p + n1);
+        this->addPiece();
+    }
+
+    // the cap at the end p of a line, going out from it in the unit direction dir
+    void cap(GPoint p, GPoint dir) {
+        GPoint n = Perp(dir) * fRadius;
+        switch (fCap) {
+            case GStrokeCap::kButt:
+                return;
+            case GStrokeCap::kRound:
+                fPiece.clear();
+                fPiece.push_back(p + n);
+                this->arc(p, n, -(float)M_PI, false);
+                fPiece.push_back(p - n);
+                break;
+            case GStrokeCap::kSquare: {
+                GPoint out = dir * fRadius;
+                fPiece.assign({p + n, p + n + out, p - n + out, p - n});
+                break;
+            }
+        }
+        this->addPiece();
+    }
+
+    // the caps of a contour with no lines (facing along x, since it has no direction)
+    void dot(GPoint p) {
+        switch (fCap) {
+            case GStrokeCap::kButt:
+                return;
+            case GStrokeCap::kRound:
+                fPiece.clear();
+                this->arc(p, {fRadius, 0}, 2 * (float)M_PI, true);
+                break;
+            case GStrokeCap::kSquare:
+                fPiece.assign({{p.fX - fRadius, p.fY - fRadius},
+                               {p.fX + fRadius, p.fY - fRadius},
+                               {p.fX + fRadius, p.fY + fRadius},
+                               {p.fX - fRadius, p.fY + fRadius}});
+                break;
+        }
+        this->addPiece();
+    }
+
+    /**
+     *  Adds the points on the circle around center from center + start, turning through
+     *  sweep radians, to fPiece. Leaves out both ends, unless withStart is true (then just
+     *  the start is added).
+     */
+    void arc(GPoint center, GPoint start, float sweep, bool withStart) {
+        int segments = (int)ceilf(fabsf(sweep) / fArcStep);
+        segments = std::max(1, std::min(segments, kMaxArcSegments));
+        float step = sweep / segments;
+        float startAngle = atan2f(start.fY, start.fX);
+        for (int i = withStart ? 0 : 1; i < segments; i++) {
+            float angle = startAngle + step * i;
+            fPiece.push_back({center.fX + fRadius * cosf(angle),
+                              center.fY + fRadius * sinf(angle)});
+        }
+    }
+
+    // adds fPiece (a convex polygon), turned around if it doesn't wind like a line's rectangle
+    void addPiece() {
+        int count = (int)fPiece.size();
+        // (twice) the signed area, measured from the first point to keep the floats small
+        float area = 0;
+        for (int i = 1; i < count - 1; i++) {
+            area += Cross(fPiece[i] - fPiece[0], fPiece[i + 1] - fPiece[0]);
+        }
+        if (area == 0) return;
+
+        if (area < 0) {
+            fDst->moveTo(fPiece[0]);
+            for (int i = 1; i < count; i++) {
+                fDst->lineTo(fPiece[i]);
+            }
+        } else {
+            fDst->moveTo(fPiece[count - 1]);
+            for (int i = count - 2; i >= 0; i--) {
+                fDst->lineTo(fPiece[i]);
+            }
+        }
+    }
+};
+
+void StrokePath(const GPath& src, const GPaint& paint, const GMatrix& ctm, GPath* dst) {
+    // curves are stroked as the lines they flatten to (on the device)
+    if (src.hasCurves()) {
+        float scale = MaxScale(ctm);
+        if (scale > 0) {
+            StrokePath(src.flattened(kRoundTolerance / scale), paint, ctm, dst);
+            return;
+        }
+    }
+
+    dst->setFillType(GPathFillType::kWinding);
+    Stroker stroker(paint, ctm, dst);
+    GPath::Contourer contourer(src);
+    const GPoint* pts;
+    int count;
+    while ((count = contourer.next(&pts)) > 0) {
+        stroker.strokeContour(pts, count);
+    }
+}
+
+GPath RectOutline(const GRect& rect) {
+    GPath path;
+    path.moveTo(rect.fLeft, rect.fTop).lineTo(rect.fRight, rect.fTop)
+        .lineTo(rect.fRight, rect.fBottom).lineTo(rect.fLeft, rect.fBottom).close();
+    return path;
+}
+
+GPath PolygonOutlines(const GPoint points[], const int counts[], int polyCount) {
+    GPath path;
+    for (int poly = 0; poly < polyCount; poly++) {
+        int count = std::max(counts[poly], 0);
+        if (count > 0) {
+            path.moveTo(points[0]);
+            for (int i = 1; i < count; i++) {
+                path.lineTo(points[i]);
+            }
+            path.close();
+        }
+        points += count;
+    }
+    return path;
+}
+
+float StrokeOutset(const GPaint& paint) {
+    float radius = std::max(paint.getStrokeWidth() / 2, 0.0f);
+    float reach = 1;
+    if (paint.getStrokeJoin() == GStrokeJoin::kMiter) {
+        reach = std::max(reach, paint.getMiterLimit());
+    }
+    if (paint.getStrokeCap() == GStrokeCap::kSquare) reach = std::max(reach, (float)M_SQRT2);
+    return radius * reach;
+}
+
+void GCanvas::drawLine(GPoint p0, GPoint p1, const GPaint& paint) {
+    GPaint stroke = paint;
+    stroke.setStroke(true);
+    GPath path;
+    path.moveTo(p0).lineTo(p1);
+    this->drawPath(path, stroke);
+}
@@ -0,0 +1,36 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef Stroker_DEFINED
+#define Stroker_DEFINED
+
+#include "include/GMatrix.h"
+#include "include/GPaint.h"
+#include "include/GPath.h"
+
+/**
+ *  Adds the area covered by stroking src's contours (with the paint's stroke width, join, cap
+ *  & miter limit) to dst, as convex pieces: one for each line, join & cap. The pieces all wind
+ *  the same way, so filling dst with kWinding covers each pixel once, even where they (or the
+ *  contours) overlap, & the whole stroke is drawn in a single pass.
+ *
+ *  A contour whose last point is on top of its first (like after close()) is stroked all the
+ *  way around, with a join there instead of caps. A contour that's just one point gets its
+ *  caps (a dot for round caps, a square for square ones).
+ *
+ *  ctm is what src will be drawn with; it only sets how many points round joins & caps get.
+ */
+void StrokePath(const GPath& src, const GPaint& paint, const GMatrix& ctm, GPath* dst);
+
+// the outline of a rect, as a closed contour (to stroke it)
+GPath RectOutline(const GRect& rect);
+
+// the outlines of convex polygons (laid out like GCanvas::drawConvexPolygons' points), as
+// closed contours
+GPath PolygonOutlines(const GPoint points[], const int counts[], int polyCount);
+
+// how far outside the bounds of a shape's points its stroke can reach (in the shape's space)
+float StrokeOutset(const GPaint& paint);
+
+#endif
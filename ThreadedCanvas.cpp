@@ -0,0 +1,549 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "include/GBitmap.h"
+#include "include/GPath.h"
+#include "include/GShader.h"
+#include "MyCanvas.h"
+#include "Stroker.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *  A fixed set of threads that run tasks [0 ... count - 1] in parallel. The thread calling
+ *  run() works on the tasks too, so a pool for N threads only starts N - 1.
+ */
+class WorkerPool {
+public:
+    WorkerPool(int threads) : fTask(nullptr), fTaskCount(0), fNext(0), fBusy(0),
+                              fGeneration(0), fQuit(false) {
+        for (int i = 1; i < threads; i++) {
+            fThreads.emplace_back([this] { this->workLoop(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fQuit = true;
+        }
+        fStart.notify_all();
+        for (std::thread& t : fThreads) {
+            t.join();
+        }
+    }
+
+    // calls task(i) for every i in [0, count), returning once they're all done
+    void run(int count, const std::function<void(int)>& task) {
+        if (count <= 0) return;
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fTask = &task;
+            fTaskCount = count;
+            fNext = 0;
+            fBusy = (int)fThreads.size();
+            fGeneration++;
+        }
+        fStart.notify_all();
+
+        this->doTasks();
+
+        std::unique_lock<std::mutex> lock(fMutex);
+        fDone.wait(lock, [this] { return fBusy == 0; });
+        fTask = nullptr;
+    }
+
+private:
+    std::vector<std::thread> fThreads;
+    std::mutex fMutex;
+    std::condition_variable fStart;
+    std::condition_variable fDone;
+
+    const std::function<void(int)>* fTask;
+    int fTaskCount;
+    std::atomic<int> fNext;     // next task for a thread to take
+    int fBusy;                  // workers that haven't finished this run yet
+    int fGeneration;            // goes up every run, to wake the workers
+    bool fQuit;
+
+    void doTasks() {
+        for (int i = fNext++; i < fTaskCount; i = fNext++) {
+            (*fTask)(i);
+        }
+    }
+
+    void workLoop() {
+        int seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(fMutex);
+                fStart.wait(lock, [&] { return fQuit || fGeneration != seen; });
+                if (fQuit) return;
+                seen = fGeneration;
+            }
+            this->doTasks();
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                if (--fBusy == 0) fDone.notify_one();
+            }
+        }
+    }
+};
+
+/**
+ *  Records each draw (with the CTM it was made with) & sorts it into the tiles its bounds
+ *  touch. Flushing draws every tile that has draws on a pool of threads, with a canvas per
+ *  tile that's clipped to it, so the tiles never touch the same pixels.
+ *
+ *  Shaders keep the context from their last setContext() call, so a draw with a shader is
+ *  drawn by itself: everything before it is flushed, its context is set here (once, not by
+ *  every tile), & it's flushed right away. (A batch of polygons is one draw.)
+ *
+ *  Clips are kept in device space (mapped by the CTM just like MyCanvas maps them), so the
+ *  tiles can apply them with no CTM & get exactly the same clip.
+ */
+class ThreadedCanvas : public GCanvas {
+public:
+    static const int kTileSize = 64;
+
+    ThreadedCanvas(const GBitmap& device, int threads)
+        : fDevice(device), fPool(std::max(threads, 1)) {
+        fTilesX = (device.width() + kTileSize - 1) / kTileSize;
+        fTilesY = (device.height() + kTileSize - 1) / kTileSize;
+        fTiles.resize(fTilesX * fTilesY);
+        for (int ty = 0; ty < fTilesY; ty++) {
+            for (int tx = 0; tx < fTilesX; tx++) {
+                fTiles[ty * fTilesX + tx].bounds = GIRect::LTRB(
+                        tx * kTileSize, ty * kTileSize,
+                        std::min((tx + 1) * kTileSize, device.width()),
+                        std::min((ty + 1) * kTileSize, device.height()));
+            }
+        }
+        fStates.push_back({GMatrix(), -1});
+    }
+
+    ~ThreadedCanvas() override {
+        this->flush();
+    }
+
+    void save() override {
+        fStates.push_back(fStates.back());
+    }
+
+    void restore() override {
+        fStates.pop_back();
+    }
+
+    void concat(const GMatrix& matrix) override {
+        fStates.back().ctm = GMatrix::Concat(fStates.back().ctm, matrix);
+    }
+
+    void clipRect(const GRect& rect) override {
+        const GMatrix& ctm = fStates.back().ctm;
+        GPoint corners[4] = {{rect.fLeft, rect.fTop}, {rect.fRight, rect.fTop},
+                             {rect.fRight, rect.fBottom}, {rect.fLeft, rect.fBottom}};
+        ctm.mapPoints(corners, 4);
+
+        Clip clip;
+        clip.parent = fStates.back().clip;
+        clip.antiAlias = false;
+        if (ctm[1] == 0 && ctm[3] == 0) {
+            // still axis-aligned, so it stays a rect (the bounds of its corners)
+            clip.isPath = false;
+            clip.rect = this->pointBounds(corners, 4);
+        } else {
+            clip.isPath = true;
+            clip.path.moveTo(corners[0]).lineTo(corners[1]).lineTo(corners[2]).lineTo(corners[3]);
+        }
+        this->pushClip(clip);
+    }
+
+    void clipPath(const GPath& path, bool antiAlias) override {
+        Clip clip;
+        clip.parent = fStates.back().clip;
+        clip.isPath = true;
+        clip.antiAlias = antiAlias;
+        clip.path = path;
+        clip.path.transform(fStates.back().ctm);
+        this->pushClip(clip);
+    }
+
+    void drawPaint(const GPaint& paint) override {
+        if (!this->beginDraw(paint)) return;
+        Command cmd = this->makeCommand(Command::kPaint, paint);
+        GRect bounds = GRect::WH(fDevice.width(), fDevice.height());
+        int clip = fStates.back().clip;
+        this->record(cmd, clip < 0 ? bounds : Intersect(bounds, fClips[clip].bounds));
+        this->endDraw(paint);
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        if (paint.isStroke()) {
+            this->drawPath(RectOutline(rect), paint);
+            return;
+        }
+        if (!this->beginDraw(paint)) return;
+        Command cmd = this->makeCommand(Command::kRect, paint);
+        cmd.rect = rect;
+        GPoint corners[4] = {{rect.fLeft, rect.fTop}, {rect.fRight, rect.fTop},
+                             {rect.fRight, rect.fBottom}, {rect.fLeft, rect.fBottom}};
+        this->record(cmd, this->deviceBounds(corners, 4));
+        this->endDraw(paint);
+    }
+
+    // (the tiles stroke round rects themselves, since their outlines are made when drawn)
+    void drawRRect(const GRect& rect, float rx, float ry, const GPaint& paint) override {
+        if (!this->beginDraw(paint)) return;
+        Command cmd = this->makeCommand(Command::kRRect, paint);
+        cmd.rect = rect;
+        cmd.rx = rx;
+        cmd.ry = ry;
+        float outset = paint.isStroke() ? StrokeOutset(paint) : 0;
+        GRect b = GRect::LTRB(std::min(rect.fLeft, rect.fRight) - outset,
+                              std::min(rect.fTop, rect.fBottom) - outset,
+                              std::max(rect.fLeft, rect.fRight) + outset,
+                              std::max(rect.fTop, rect.fBottom) + outset);
+        GPoint corners[4] = {{b.fLeft, b.fTop}, {b.fRight, b.fTop},
+                             {b.fRight, b.fBottom}, {b.fLeft, b.fBottom}};
+        this->record(cmd, this->deviceBounds(corners, 4));
+        this->endDraw(paint);
+    }
+
+    void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) override {
+        this->drawConvexPolygons(points, &count, 1, paint);
+    }
+
+    void drawConvexPolygons(const GPoint points[], const int counts[], int polyCount,
+                            const GPaint& paint) override {
+        if (paint.isStroke()) {
+            this->drawPath(PolygonOutlines(points, counts, polyCount), paint);
+            return;
+        }
+        if (!this->beginDraw(paint)) return;
+
+        // each polygon goes only to the tiles it touches, but the tiles put consecutive
+        // polygons from this call back together to draw them as a batch
+        int batch = fNextBatch++;
+        for (int i = 0; i < polyCount; i++) {
+            int count = counts[i];
+            if (count <= 0) continue;
+            Command cmd = this->makeCommand(Command::kPolygon, paint);
+            cmd.batch = batch;
+            cmd.ptIndex = (int)fPoints.size();
+            cmd.ptCount = count;
+            fPoints.insert(fPoints.end(), points, points + count);
+            this->record(cmd, this->deviceBounds(points, count));
+            points += count;
+        }
+        this->endDraw(paint);
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        // strokes are stroked here, once, & the tiles just fill them (like MyCanvas does)
+        if (paint.isStroke()) {
+            GPath stroke;
+            StrokePath(path, paint, fStates.back().ctm, &stroke);
+            GPaint fill = paint;
+            fill.setStroke(false);
+            this->drawPath(stroke, fill);
+            return;
+        }
+
+        if (!this->beginDraw(paint)) return;
+        Command cmd = this->makeCommand(Command::kPath, paint);
+        cmd.pathIndex = (int)fPaths.size();
+        fPaths.push_back(path);
+        GRect b = path.bounds();
+        GPoint corners[4] = {{b.fLeft, b.fTop}, {b.fRight, b.fTop},
+                             {b.fRight, b.fBottom}, {b.fLeft, b.fBottom}};
+        this->record(cmd, this->deviceBounds(corners, 4));
+        this->endDraw(paint);
+    }
+
+    // (there's no telling exactly which pixels a path clip lets through, until it's drawn)
+    bool getDeviceState(GMatrix* ctm, GIRect* bounds) const override {
+        *ctm = fStates.back().ctm;
+        *bounds = GIRect::WH(fDevice.width(), fDevice.height());
+        for (int c = fStates.back().clip; c >= 0; c = fClips[c].parent) {
+            if (fClips[c].isPath) return false;
+            *bounds = Intersect(*bounds, fClips[c].rect.round());
+        }
+        return true;
+    }
+
+    void flush() override {
+        // just the tiles that have something to draw
+        fBusyTiles.clear();
+        for (int i = 0; i < (int)fTiles.size(); i++) {
+            if (!fTiles[i].commands.empty()) fBusyTiles.push_back(i);
+        }
+        fPool.run((int)fBusyTiles.size(), [&](int i) {
+            this->drawTile(&fTiles[fBusyTiles[i]]);
+        });
+
+        for (Tile& tile : fTiles) {
+            tile.commands.clear();
+        }
+        fCommands.clear();
+        fPoints.clear();
+        fPaths.clear();
+        this->compactClips();
+    }
+
+private:
+    // a clip in device space, which narrows down the clip it was made in (its parent)
+    struct Clip {
+        int parent;             // index in fClips, or -1 if it's the first
+        bool isPath;
+        bool antiAlias;
+        GRect rect;             // if it's not a path
+        GPath path;
+        GRect bounds;           // device bounds of this clip & all of its parents
+    };
+
+    struct State {
+        GMatrix ctm;
+        int clip;               // index in fClips, or -1 for no clip
+    };
+
+    struct Command {
+        enum Kind { kPaint, kRect, kRRect, kPolygon, kPath };
+        Kind kind;
+        GMatrix ctm;
+        int clip;
+        GPaint paint;
+        GRect rect;             // kRect & kRRect
+        float rx, ry;           // kRRect
+        int ptIndex, ptCount;   // kPolygon, its points in fPoints
+        int batch;              // kPolygon, the drawConvexPolygons() call it came from
+        int pathIndex;          // kPath, in fPaths
+    };
+
+    struct Tile {
+        GIRect bounds;
+        std::unique_ptr<GCanvas> canvas;    // made the first time the tile has draws
+        std::vector<int> commands;          // indices into fCommands, in the order drawn
+        // scratch space for putting batches of polygons back together
+        std::vector<GPoint> batchPoints;
+        std::vector<int> batchCounts;
+    };
+
+    const GBitmap fDevice;
+    WorkerPool fPool;
+    std::vector<State> fStates;
+    std::vector<Clip> fClips;
+    std::vector<int> fClipRemap;    // scratch for compactClips()
+
+    int fTilesX, fTilesY;
+    std::vector<Tile> fTiles;
+    std::vector<int> fBusyTiles;    // the tiles a flush draws (kept to reuse its memory)
+
+    std::vector<Command> fCommands;
+    std::vector<GPoint> fPoints;
+    std::vector<GPath> fPaths;
+    int fNextBatch = 0;
+
+    // starts a draw, returning false if there's nothing to draw (a shader's draw first flushes
+    // the draws before it, since their tiles may still need the shader's old context)
+    bool beginDraw(const GPaint& paint) {
+        GShader* shader = paint.getShader();
+        if (shader == nullptr) return true;
+        this->flush();
+        return shader->setContext(fStates.back().ctm);
+    }
+
+    // & ends it (a shader's draw is flushed right away, while its context is still set)
+    void endDraw(const GPaint& paint) {
+        if (paint.getShader() != nullptr) this->flush();
+    }
+
+    Command makeCommand(Command::Kind kind, const GPaint& paint) {
+        Command cmd;
+        cmd.kind = kind;
+        cmd.ctm = fStates.back().ctm;
+        cmd.clip = fStates.back().clip;
+        cmd.paint = paint;
+        cmd.ptIndex = cmd.ptCount = cmd.batch = cmd.pathIndex = 0;
+        return cmd;
+    }
+
+    static GRect pointBounds(const GPoint pts[], int count) {
+        if (count <= 0) return GRect::LTRB(0, 0, 0, 0);
+        GRect bounds = GRect::LTRB(pts[0].fX, pts[0].fY, pts[0].fX, pts[0].fY);
+        for (int i = 1; i < count; i++) {
+            bounds.fLeft = std::min(bounds.fLeft, pts[i].fX);
+            bounds.fTop = std::min(bounds.fTop, pts[i].fY);
+            bounds.fRight = std::max(bounds.fRight, pts[i].fX);
+            bounds.fBottom = std::max(bounds.fBottom, pts[i].fY);
+        }
+        return bounds;
+    }
+
+    static GRect Intersect(const GRect& a, const GRect& b) {
+        return GRect::LTRB(std::max(a.fLeft, b.fLeft), std::max(a.fTop, b.fTop),
+                           std::min(a.fRight, b.fRight), std::min(a.fBottom, b.fBottom));
+    }
+
+    static GIRect Intersect(const GIRect& a, const GIRect& b) {
+        return GIRect::LTRB(std::max(a.fLeft, b.fLeft), std::max(a.fTop, b.fTop),
+                            std::min(a.fRight, b.fRight), std::min(a.fBottom, b.fBottom));
+    }
+
+    // the bounds of the points after the CTM maps them (& cut down to the clip)
+    GRect deviceBounds(const GPoint pts[], int count) const {
+        if (count <= 0) return GRect::LTRB(0, 0, 0, 0);
+        const GMatrix& ctm = fStates.back().ctm;
+        GPoint first = ctm * pts[0];
+        GRect bounds = GRect::LTRB(first.fX, first.fY, first.fX, first.fY);
+        for (int i = 1; i < count; i++) {
+            GPoint p = ctm * pts[i];
+            bounds.fLeft = std::min(bounds.fLeft, p.fX);
+            bounds.fTop = std::min(bounds.fTop, p.fY);
+            bounds.fRight = std::max(bounds.fRight, p.fX);
+            bounds.fBottom = std::max(bounds.fBottom, p.fY);
+        }
+        int clip = fStates.back().clip;
+        return clip < 0 ? bounds : Intersect(bounds, fClips[clip].bounds);
+    }
+
+    // makes the clip the current one
+    void pushClip(Clip& clip) {
+        // round out rects, since they keep the pixels whose centers are inside
+        GRect bounds = clip.isPath ? clip.path.bounds()
+                                   : GRect::LTRB(floorf(clip.rect.fLeft), floorf(clip.rect.fTop),
+                                                 ceilf(clip.rect.fRight),
+                                                 ceilf(clip.rect.fBottom));
+        clip.bounds = clip.parent < 0 ? bounds : Intersect(bounds, fClips[clip.parent].bounds);
+        fStates.back().clip = (int)fClips.size();
+        fClips.push_back(clip);
+    }
+
+    // drops the clips that no state uses anymore (only call with no commands recorded, & before
+    // a draw reads its clip from the state, since this renumbers them)
+    void compactClips() {
+        // mark the clips the states use, & their parents
+        fClipRemap.assign(fClips.size(), -1);
+        for (const State& state : fStates) {
+            for (int c = state.clip; c >= 0 && fClipRemap[c] < 0; c = fClips[c].parent) {
+                fClipRemap[c] = 0;
+            }
+        }
+        // & slide the marked ones down over the rest (parents always come before their
+        // children, so they're renumbered first)
+        int kept = 0;
+        for (int c = 0; c < (int)fClips.size(); c++) {
+            if (fClipRemap[c] < 0) continue;
+            int parent = fClips[c].parent;
+            if (c != kept) fClips[kept] = std::move(fClips[c]);
+            fClips[kept].parent = parent < 0 ? -1 : fClipRemap[parent];
+            fClipRemap[c] = kept++;
+        }
+        fClips.erase(fClips.begin() + kept, fClips.end());
+        for (State& state : fStates) {
+            if (state.clip >= 0) state.clip = fClipRemap[state.clip];
+        }
+    }
+
+    // applies the clip (& its parents) to a tile's canvas, which has no CTM
+    void applyClip(GCanvas* canvas, int c) const {
+        if (c < 0) return;
+        this->applyClip(canvas, fClips[c].parent);
+        if (fClips[c].isPath) {
+            canvas->clipPath(fClips[c].path, fClips[c].antiAlias);
+        } else {
+            canvas->clipRect(fClips[c].rect);
+        }
+    }
+
+    // adds the draw to every tile that its device bounds touch
+    void record(const Command& cmd, const GRect& bounds) {
+        int index = (int)fCommands.size();
+        fCommands.push_back(cmd);
+
+        // pad by a pixel, since pixels are in if their centers are (& anti-aliasing can
+        // touch the pixels the bounds end in)
+        int left = std::max(GFloorToInt(bounds.fLeft) - 1, 0);
+        int top = std::max(GFloorToInt(bounds.fTop) - 1, 0);
+        int right = std::min(GCeilToInt(bounds.fRight) + 1, fDevice.width());
+        int bottom = std::min(GCeilToInt(bounds.fBottom) + 1, fDevice.height());
+        if (left < right && top < bottom) {
+            for (int ty = top / kTileSize; ty <= (bottom - 1) / kTileSize; ty++) {
+                for (int tx = left / kTileSize; tx <= (right - 1) / kTileSize; tx++) {
+                    fTiles[ty * fTilesX + tx].commands.push_back(index);
+                }
+            }
+        }
+    }
+
+    // plays back the tile's draws into its clipped canvas (on a worker thread)
+    void drawTile(Tile* tile) {
+        if (!tile->canvas) {
+            tile->canvas = CreateClippedCanvas(fDevice, tile->bounds, false);
+        }
+        GCanvas* canvas = tile->canvas.get();
+
+        // the clip stays applied (in its own save) for as long as the draws share it
+        int clip = -1;
+        canvas->save();
+
+        const std::vector<int>& commands = tile->commands;
+        for (size_t i = 0; i < commands.size(); i++) {
+            const Command& cmd = fCommands[commands[i]];
+            if (cmd.clip != clip) {
+                canvas->restore();
+                canvas->save();
+                this->applyClip(canvas, cmd.clip);
+                clip = cmd.clip;
+            }
+            canvas->save();
+            canvas->concat(cmd.ctm);
+            switch (cmd.kind) {
+                case Command::kPaint:
+                    canvas->drawPaint(cmd.paint);
+                    break;
+                case Command::kRect:
+                    canvas->drawRect(cmd.rect, cmd.paint);
+                    break;
+                case Command::kRRect:
+                    canvas->drawRRect(cmd.rect, cmd.rx, cmd.ry, cmd.paint);
+                    break;
+                case Command::kPolygon: {
+                    // gather the rest of this batch that's in the tile
+                    tile->batchPoints.clear();
+                    tile->batchCounts.clear();
+                    for (;;) {
+                        const Command& poly = fCommands[commands[i]];
+                        const GPoint* pts = &fPoints[poly.ptIndex];
+                        tile->batchPoints.insert(tile->batchPoints.end(), pts,
+                                                 pts + poly.ptCount);
+                        tile->batchCounts.push_back(poly.ptCount);
+                        if (i + 1 == commands.size()) break;
+                        const Command& next = fCommands[commands[i + 1]];
+                        if (next.kind != Command::kPolygon || next.batch != cmd.batch) break;
+                        i++;
+                    }
+                    canvas->drawConvexPolygons(tile->batchPoints.data(),
+                                               tile->batchCounts.data(),
+                                               (int)tile->batchCounts.size(), cmd.paint);
+                    break;
+                }
+                case Command::kPath:
+                    canvas->drawPath(fPaths[cmd.pathIndex], cmd.paint);
+                    break;
+            }
+            canvas->restore();
+        }
+        canvas->restore();
+    }
+};
+
+std::unique_ptr<GCanvas> GCreateThreadedCanvas(const GBitmap& device, int threads) {
+    if (!device.pixels() || device.width() <= 0 || device.height() <= 0) return nullptr;
+    return std::unique_ptr<GCanvas>(new ThreadedCanvas(device, threads));
+}
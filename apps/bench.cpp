@@ -23,11 +23,13 @@ enum Mode {
     kOnce,
 };
 
-static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode) {
+// threads == 0 draws with the regular canvas, otherwise with a threaded one
+static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode,
+                          int threads = 0) {
     GISize size = bench->size();
     setup_bitmap(bitmap, size.fWidth, size.fHeight);
 
-    auto canvas = GCreateCanvas(*bitmap);
+    auto canvas = threads > 0 ? GCreateThreadedCanvas(*bitmap, threads) : GCreateCanvas(*bitmap);
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 size.fWidth, size.fHeight, bench->name());
@@ -50,6 +52,7 @@ static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap,
     for (int i = 0; i < N || forever; ++i) {
         bench->draw(canvas.get());
     }
+    canvas->flush();
     GMSec dur = GTime::GetMSec() - now;
     return dur * 1.0 / N;
 }
@@ -92,6 +95,7 @@ int main_bench(int argc, const char* argv[]) {
     std::vector<double> inScores;
     bool chatty_mode = true;
     bool write_images = false;
+    int maxThreads = 0;
 
     int count = -1;
     while (gBenchFactories[++count]);
@@ -116,6 +120,13 @@ int main_bench(int argc, const char* argv[]) {
             chatty_mode = false;
         } else if (is_arg(argv[i], "writeImages")) {
             write_images = true;
+        } else if (is_arg(argv[i], "threads") && i+1 < argc) {
+            maxThreads = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "cpu") && i+1 < argc) {
+            if (!GSetCPULevel(argv[++i])) {
+                printf("Can't use cpu level %s\n", argv[i]);
+                return -1;
+            }
         } else {
             printf("Unknown arg %s\n", argv[i]);
             return -1;
@@ -127,6 +138,10 @@ int main_bench(int argc, const char* argv[]) {
         return -1;
     }
 
+    if (chatty_mode) {
+        printf("cpu level: %s\n", GGetCPULevel());
+    }
+
     std::vector<double> durs;
     double quotient = 0;
     for (int i = 0; i < count; ++i) {
@@ -153,6 +168,17 @@ int main_bench(int argc, const char* argv[]) {
         }
         durs.push_back(dur);
 
+        // how the time scales with threads (1, 2, 4, ... up to maxThreads)
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            GBitmap threadBM;
+            double threadDur = handle_proc(bench.get(), name, &threadBM, mode, threads);
+            if (chatty_mode) {
+                printf("    %d thread%s %g [%.2fx]\n", threads, threads > 1 ? "s" : "",
+                       threadDur, threadDur > 0 ? dur / threadDur : 0.0);
+            }
+            free(threadBM.pixels());
+        }
+
         if (write_images) {
             std::string str(name);
             str += ".png";
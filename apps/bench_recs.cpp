@@ -6,9 +6,12 @@
 #include "../include/GCanvas.h"
 #include "../include/GBitmap.h"
 #include "../include/GColor.h"
+#include "../include/GPath.h"
+#include "../include/GPicture.h"
 #include "../include/GRandom.h"
 #include "../include/GRect.h"
 #include <string>
+#include <vector>
 
 static GColor rand_color(GRandom& rand, bool forceOpaque = false) {
     GColor c { rand.nextF(), rand.nextF(), rand.nextF(), rand.nextF() };
@@ -21,6 +24,7 @@ static GColor rand_color(GRandom& rand, bool forceOpaque = false) {
 #include "bench_pa1.inc"
 #include "bench_pa2.inc"
 #include "bench_pa3.inc"
+#include "bench_extra.inc"
 
 const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new RectsBench(false); },
@@ -45,5 +49,38 @@ const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_opaque"); },
     []() -> GBenchmark* { return new BitmapBench("apps/wheel.png", "bitmap_alpha"); },
 
+    // extra
+    []() -> GBenchmark* { return new ManyQuadsBench(false); },
+    []() -> GBenchmark* { return new ManyQuadsBench(true);  },
+    []() -> GBenchmark* { return new PictureBench; },
+    []() -> GBenchmark* { return new OccludedPictureBench; },
+    []() -> GBenchmark* { return new ScrolledBench; },
+    []() -> GBenchmark* { return new ClippedBench(false); },
+    []() -> GBenchmark* { return new ClippedBench(true);  },
+    []() -> GBenchmark* { return new PolylineBench; },
+    []() -> GBenchmark* { return new OvalsBench(true);  },
+    []() -> GBenchmark* { return new OvalsBench(false); },
+    []() -> GBenchmark* { return new RRectsBench; },
+    []() -> GBenchmark* { return new CubicsBench(true);  },
+    []() -> GBenchmark* { return new CubicsBench(false); },
+    []() -> GBenchmark* { return new ScrolledBitmapBench; },
+    []() -> GBenchmark* { return new RotatedBitmapBench; },
+    []() -> GBenchmark* {
+        return new FilteredBitmapBench("apps/spock.png", "bitmap_opaque_bilinear",
+                                       GFilterQuality::kBilinear);
+    },
+    []() -> GBenchmark* {
+        return new FilteredBitmapBench("apps/spock.png", "bitmap_opaque_bicubic",
+                                       GFilterQuality::kBicubic);
+    },
+    []() -> GBenchmark* {
+        return new FilteredBitmapBench("apps/wheel.png", "bitmap_alpha_bilinear",
+                                       GFilterQuality::kBilinear);
+    },
+    []() -> GBenchmark* {
+        return new FilteredBitmapBench("apps/wheel.png", "bitmap_alpha_bicubic",
+                                       GFilterQuality::kBicubic);
+    },
+
     nullptr,
 };
@@ -0,0 +1,599 @@
+/**
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "../include/GPath.h"
+#include "../include/GPicture.h"
+#include "../BlendRows.h"
+#include "../SampleRows.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// a tiny deterministic generator, so the random inputs are the same every run
+static uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+// a random premultiplied pixel, a lot of the time exactly transparent or opaque
+static GPixel random_pixel(uint32_t* seed) {
+    unsigned pick = next_random(seed) % 4;
+    unsigned a = pick == 0 ? 0 : pick == 1 ? 255 : next_random(seed) & 0xFF;
+    return GPixel_PackARGB(a, next_random(seed) % (a + 1), next_random(seed) % (a + 1),
+                           next_random(seed) % (a + 1));
+}
+
+// calls check() at every SIMD level this CPU can run, then goes back to the level it was at
+template <typename Check> static void for_each_simd_level(Check&& check) {
+    std::string original = GGetCPULevel();
+    for (const char* level : { "sse2", "avx2", "avx512" }) {
+        if (GSetCPULevel(level)) check();
+    }
+    GSetCPULevel(original.c_str());
+}
+
+// lengths around every vector width, so the scalar tails run too
+static const int gRowCounts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 67 };
+static const int kMaxRowCount = 67;
+
+static void test_blend_levels(GTestStats* stats) {
+    GPixel src[kMaxRowCount], dst[kMaxRowCount], expected[kMaxRowCount], actual[kMaxRowCount];
+    uint32_t seed = 1;
+
+    for (int m = 0; m <= (int)GBlendMode::kXor; ++m) {
+        GBlendMode mode = (GBlendMode)m;
+        GSetCPULevel("scalar");
+        BlendRowProc scalarRow = GetBlendRowProc(mode);
+        BlendColorProc scalarColor = GetBlendColorProc(mode);
+        const GPixel colors[] = { GPixel_PackARGB(0, 0, 0, 0),
+                                  GPixel_PackARGB(0xFF, 0x12, 0x80, 0xFF),
+                                  random_pixel(&seed) };
+
+        bool rowsMatch = true, colorsMatch = true;
+        for (int count : gRowCounts) {
+            for (int i = 0; i < count; ++i) {
+                src[i] = random_pixel(&seed);
+                dst[i] = random_pixel(&seed);
+            }
+
+            for_each_simd_level([&]() {
+                BlendRowProc row = GetBlendRowProc(mode);
+                BlendColorProc color = GetBlendColorProc(mode);
+                // (kDst has no procs at any level, since it changes nothing)
+                if (!scalarRow || !row) {
+                    rowsMatch &= !scalarRow && !row;
+                    colorsMatch &= !scalarColor && !color;
+                    return;
+                }
+
+                memcpy(expected, dst, count * sizeof(GPixel));
+                memcpy(actual, dst, count * sizeof(GPixel));
+                scalarRow(src, expected, count);
+                row(src, actual, count);
+                rowsMatch &= memcmp(expected, actual, count * sizeof(GPixel)) == 0;
+
+                for (GPixel c : colors) {
+                    memcpy(expected, dst, count * sizeof(GPixel));
+                    memcpy(actual, dst, count * sizeof(GPixel));
+                    scalarColor(c, expected, count);
+                    color(c, actual, count);
+                    colorsMatch &= memcmp(expected, actual, count * sizeof(GPixel)) == 0;
+                }
+            });
+        }
+        stats->expectTrue(rowsMatch, "blend_row_levels_match_scalar");
+        stats->expectTrue(colorsMatch, "blend_color_levels_match_scalar");
+    }
+
+    // & anti-aliased rows, which move the dst towards the src by how much it's covered
+    uint8_t coverage[kMaxRowCount];
+    GSetCPULevel("scalar");
+    LerpRowProc scalarLerp = GetLerpRowProc();
+    bool lerpsMatch = true;
+    for (int count : gRowCounts) {
+        for (int i = 0; i < count; ++i) {
+            src[i] = random_pixel(&seed);
+            dst[i] = random_pixel(&seed);
+            unsigned pick = next_random(&seed) % 4;
+            coverage[i] = pick == 0 ? 0 : pick == 1 ? 255 : next_random(&seed) & 0xFF;
+        }
+        for_each_simd_level([&]() {
+            memcpy(expected, dst, count * sizeof(GPixel));
+            memcpy(actual, dst, count * sizeof(GPixel));
+            scalarLerp(src, coverage, expected, count);
+            GetLerpRowProc()(src, coverage, actual, count);
+            lerpsMatch &= memcmp(expected, actual, count * sizeof(GPixel)) == 0;
+        });
+    }
+    stats->expectTrue(lerpsMatch, "lerp_row_levels_match_scalar");
+}
+
+// a small canvas to draw into, that starts out all transparent
+struct TestCanvas {
+    std::vector<GPixel> pixels;
+    GBitmap bitmap;
+    std::unique_ptr<GCanvas> canvas;
+
+    TestCanvas(int w, int h)
+        : pixels(w * h, 0), bitmap(w, h, w * sizeof(GPixel), pixels.data(), false),
+          canvas(GCreateCanvas(bitmap)) {}
+
+    GPixel at(int x, int y) const { return pixels[y * bitmap.width() + x]; }
+};
+
+static void test_path_fill_types(GTestStats* stats) {
+    // a five pointed star, drawn in one go, so its middle is wound around twice
+    GPath star;
+    for (int i = 0; i < 5; ++i) {
+        float angle = (float)(-M_PI / 2 + i * 4 * M_PI / 5);
+        GPoint p = { 50 + 40 * cosf(angle), 50 + 40 * sinf(angle) };
+        i == 0 ? star.moveTo(p) : star.lineTo(p);
+    }
+    const GPaint paint(GColor::RGBA(1, 0, 0, 1));
+    const GPixel red = GPixel_PackARGB(0xFF, 0xFF, 0, 0);
+
+    TestCanvas winding(100, 100);
+    winding.canvas->drawPath(star, paint);
+    stats->expectEQ(winding.at(50, 50), red, "path_winding_fills_middle");
+    stats->expectEQ(winding.at(50, 20), red, "path_winding_fills_point");
+    stats->expectEQ(winding.at(5, 95), (GPixel)0, "path_winding_outside");
+
+    star.setFillType(GPathFillType::kEvenOdd);
+    TestCanvas evenOdd(100, 100);
+    evenOdd.canvas->drawPath(star, paint);
+    stats->expectEQ(evenOdd.at(50, 50), (GPixel)0, "path_evenodd_skips_middle");
+    stats->expectEQ(evenOdd.at(50, 20), red, "path_evenodd_fills_point");
+    stats->expectEQ(evenOdd.at(5, 95), (GPixel)0, "path_evenodd_outside");
+}
+
+static void test_aa_coverage(GTestStats* stats) {
+    const GPaint paint = GPaint(GColor::RGBA(1, 1, 1, 1)).setAntiAlias(true);
+    const GPixel half = GPixel_PackARGB(0x80, 0x80, 0x80, 0x80);
+    const GPixel quarter = GPixel_PackARGB(0x40, 0x40, 0x40, 0x40);
+    const GPixel full = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+
+    // pixel column 10 & row 10 are cut in half by the sides, & pixel [10, 10] in quarters
+    TestCanvas test(20, 20);
+    const GPoint pts[] = { {0, 0}, {10.5f, 0}, {10.5f, 10.5f}, {0, 10.5f} };
+    test.canvas->drawConvexPolygon(pts, 4, paint);
+    stats->expectEQ(test.at(5, 5), full, "aa_covered_pixel");
+    stats->expectEQ(test.at(10, 5), half, "aa_half_covered_column");
+    stats->expectEQ(test.at(5, 10), half, "aa_half_covered_row");
+    stats->expectEQ(test.at(10, 10), quarter, "aa_quarter_covered_corner");
+    stats->expectEQ(test.at(11, 5), (GPixel)0, "aa_uncovered_pixel");
+
+    // without anti-aliasing, pixels are in or out by their centers
+    TestCanvas aliased(20, 20);
+    aliased.canvas->drawConvexPolygon(pts, 4, GPaint(GColor::RGBA(1, 1, 1, 1)));
+    stats->expectEQ(aliased.at(10, 10), full, "aliased_center_inside");
+}
+
+// a bit of everything a picture records, some of it hidden under the opaque rect at the end
+static void draw_picture_scene(GCanvas* canvas) {
+    canvas->drawPaint(GPaint(GColor::RGBA(0.1f, 0.2f, 0.3f, 1)));
+    canvas->save();
+    canvas->concat(GMatrix::Translate(10, 5) * GMatrix::Rotate(0.3f));
+    canvas->drawRect(GRect::LTRB(0, 0, 40, 30), GPaint(GColor::RGBA(1, 0, 0, 0.5f)));
+    const GPoint tri[] = { {50, 10}, {90, 40}, {20, 60} };
+    canvas->drawConvexPolygon(tri, 3, GPaint(GColor::RGBA(0, 1, 0, 0.75f)).setAntiAlias(true));
+    canvas->restore();
+
+    GPath path;
+    path.moveTo(60, 60).lineTo(95, 70).lineTo(70, 95).lineTo(65, 50);
+    canvas->drawPath(path, GPaint(GColor::RGBA(0, 0, 1, 0.6f))
+                               .setBlendMode(GBlendMode::kXor));
+    canvas->drawRect(GRect::LTRB(5, 55, 45, 95), GPaint(GColor::RGBA(1, 1, 0, 1)));
+}
+
+static bool same_pixels(const TestCanvas& a, const TestCanvas& b) {
+    return a.pixels == b.pixels;
+}
+
+static void test_picture_playback(GTestStats* stats) {
+    GPictureRecorder recorder;
+    draw_picture_scene(recorder.beginRecording());
+    std::unique_ptr<GPicture> picture = recorder.finishRecording();
+
+    TestCanvas direct(100, 100), played(100, 100);
+    draw_picture_scene(direct.canvas.get());
+    picture->playback(played.canvas.get());
+    stats->expectTrue(same_pixels(direct, played), "picture_playback_matches_direct");
+
+    // played back on top of the canvas's CTM (which it leaves as it was)
+    TestCanvas movedDirect(100, 100), movedPlayed(100, 100);
+    movedDirect.canvas->concat(GMatrix::Translate(3, -2) * GMatrix::Scale(0.8f, 0.9f));
+    draw_picture_scene(movedDirect.canvas.get());
+    movedPlayed.canvas->concat(GMatrix::Translate(3, -2) * GMatrix::Scale(0.8f, 0.9f));
+    picture->playback(movedPlayed.canvas.get());
+    movedDirect.canvas->drawRect(GRect::LTRB(0, 0, 10, 10), GPaint(GColor::RGBA(1, 1, 1, 1)));
+    movedPlayed.canvas->drawRect(GRect::LTRB(0, 0, 10, 10), GPaint(GColor::RGBA(1, 1, 1, 1)));
+    stats->expectTrue(same_pixels(movedDirect, movedPlayed), "picture_playback_under_ctm");
+}
+
+// passes every call on to another canvas, but can't say where its draws land, so a picture
+// played into it can't leave anything out
+class ForwardingCanvas : public GCanvas {
+public:
+    ForwardingCanvas(GCanvas* canvas) : fCanvas(canvas) {}
+
+    void save() override { fCanvas->save(); }
+    void restore() override { fCanvas->restore(); }
+    void concat(const GMatrix& m) override { fCanvas->concat(m); }
+    void clipRect(const GRect& rect) override { fCanvas->clipRect(rect); }
+    void clipPath(const GPath& path, bool aa) override { fCanvas->clipPath(path, aa); }
+    void drawPaint(const GPaint& paint) override { fCanvas->drawPaint(paint); }
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        fCanvas->drawRect(rect, paint);
+    }
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint& paint) override {
+        fCanvas->drawConvexPolygon(pts, count, paint);
+    }
+    void drawConvexPolygons(const GPoint pts[], const int counts[], int polyCount,
+                            const GPaint& paint) override {
+        fCanvas->drawConvexPolygons(pts, counts, polyCount, paint);
+    }
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        fCanvas->drawPath(path, paint);
+    }
+    void drawRRect(const GRect& rect, float rx, float ry, const GPaint& paint) override {
+        fCanvas->drawRRect(rect, rx, ry, paint);
+    }
+
+private:
+    GCanvas* fCanvas;
+};
+
+static void test_picture_cull(GTestStats* stats) {
+    // the opaque rect at the end covers the first rect, & part of the second
+    GPictureRecorder recorder;
+    GCanvas* rec = recorder.beginRecording();
+    draw_picture_scene(rec);
+    rec->drawRect(GRect::LTRB(20, 20, 40, 40), GPaint(GColor::RGBA(1, 0, 0, 0.5f)));
+    rec->drawRect(GRect::LTRB(50, 10, 90, 50), GPaint(GColor::RGBA(0, 1, 0, 0.5f)));
+    rec->drawRect(GRect::LTRB(10, 10, 70, 70), GPaint(GColor::RGBA(0.5f, 0.5f, 0.5f, 1)));
+    std::unique_ptr<GPicture> picture = recorder.finishRecording();
+
+    TestCanvas direct(100, 100), culled(100, 100), unculled(100, 100);
+    GCanvas* canvas = direct.canvas.get();
+    draw_picture_scene(canvas);
+    canvas->drawRect(GRect::LTRB(20, 20, 40, 40), GPaint(GColor::RGBA(1, 0, 0, 0.5f)));
+    canvas->drawRect(GRect::LTRB(50, 10, 90, 50), GPaint(GColor::RGBA(0, 1, 0, 0.5f)));
+    canvas->drawRect(GRect::LTRB(10, 10, 70, 70), GPaint(GColor::RGBA(0.5f, 0.5f, 0.5f, 1)));
+
+    GPictureStats culledStats, unculledStats;
+    picture->playback(culled.canvas.get(), &culledStats);
+    ForwardingCanvas forwarding(unculled.canvas.get());
+    picture->playback(&forwarding, &unculledStats);
+
+    stats->expectTrue(culledStats.culledDraws > 0, "picture_cull_skips_hidden_draws");
+    stats->expectTrue(culledStats.trimmedDraws > 0, "picture_cull_trims_covered_rects");
+    stats->expectTrue(same_pixels(direct, culled), "picture_culled_matches_direct");
+    stats->expectEQ(unculledStats.culledDraws + unculledStats.trimmedDraws, 0,
+                    "picture_no_cull_without_device_state");
+    stats->expectTrue(same_pixels(direct, unculled), "picture_unculled_matches_direct");
+}
+
+static void test_clip_save_restore(GTestStats* stats) {
+    const GPaint white(GColor::RGBA(1, 1, 1, 1));
+    const GPixel W = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+
+    TestCanvas test(100, 100);
+    GCanvas* canvas = test.canvas.get();
+    canvas->save();
+    canvas->clipRect(GRect::LTRB(10, 10, 50, 50));
+    canvas->save();
+    GPath tri;
+    tri.moveTo(0, 0).lineTo(100, 0).lineTo(0, 100);
+    canvas->clipPath(tri, false);
+    canvas->drawRect(GRect::LTRB(0, 0, 100, 20), white);
+    canvas->restore();
+    // (only the rect clip is left)
+    canvas->drawRect(GRect::LTRB(0, 40, 100, 60), white);
+    canvas->restore();
+    // (& now nothing)
+    canvas->drawRect(GRect::LTRB(0, 90, 100, 100), white);
+
+    stats->expectEQ(test.at(15, 15), W, "clip_both_inside");
+    stats->expectEQ(test.at(5, 15), (GPixel)0, "clip_outside_rect");
+    stats->expectEQ(test.at(45, 45), W, "clip_path_restored");
+    stats->expectEQ(test.at(60, 45), (GPixel)0, "clip_rect_still_on");
+    stats->expectEQ(test.at(15, 55), (GPixel)0, "clip_rect_bottom");
+    stats->expectEQ(test.at(95, 95), W, "clip_rect_restored");
+
+    // the path clip holds pixels past its diagonal back
+    TestCanvas pathOnly(100, 100);
+    pathOnly.canvas->clipPath(tri, false);
+    pathOnly.canvas->drawPaint(white);
+    stats->expectEQ(pathOnly.at(10, 10), W, "clip_path_inside");
+    stats->expectEQ(pathOnly.at(80, 80), (GPixel)0, "clip_path_outside");
+}
+
+// the largest difference in any channel between the two canvases' pixels
+static int max_channel_diff(const TestCanvas& a, const TestCanvas& b) {
+    int diff = 0;
+    for (size_t i = 0; i < a.pixels.size(); ++i) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            int ca = (a.pixels[i] >> shift) & 0xFF, cb = (b.pixels[i] >> shift) & 0xFF;
+            diff = std::max(diff, std::abs(ca - cb));
+        }
+    }
+    return diff;
+}
+
+static int count_diff_pixels(const TestCanvas& a, const TestCanvas& b) {
+    int count = 0;
+    for (size_t i = 0; i < a.pixels.size(); ++i) {
+        count += a.pixels[i] != b.pixels[i];
+    }
+    return count;
+}
+
+// the area that was drawn (in pixels, counting partly covered ones by their alpha)
+static float covered_area(const TestCanvas& test) {
+    float area = 0;
+    for (GPixel p : test.pixels) {
+        area += GPixel_GetA(p) / 255.0f;
+    }
+    return area;
+}
+
+static void test_rrect_matches_polygon(GTestStats* stats) {
+    struct Shape { GRect rect; float rx, ry; } shapes[] = {
+        { GRect::LTRB(10, 12, 90, 70),             12,  8 },
+        { GRect::LTRB(20.5f, 5.25f, 75, 95),        6, 30 },
+        { GRect::LTRB(5, 5, 95, 95),               45, 45 },    // (a circle)
+        { GRect::LTRB(30.3f, 40.7f, 80.1f, 60.2f), 25, 10 },    // (an oval)
+    };
+    // swapping x & y flips the shape over its diagonal, which sends it down the polygon
+    // fallback (drawn flipped back, so it should land on the same pixels)
+    const GMatrix swapXY(0, 1, 0, 1, 0, 0);
+
+    bool areasMatch = true, aaClose = true, bwClose = true;
+    for (bool aa : {false, true}) {
+        GPaint paint(GColor::RGBA(0.9f, 0.3f, 0.1f, 1));
+        paint.setAntiAlias(aa);
+        for (const Shape& shape : shapes) {
+            const GRect& r = shape.rect;
+            TestCanvas analytic(100, 100), polygon(100, 100);
+            analytic.canvas->drawRRect(r, shape.rx, shape.ry, paint);
+            polygon.canvas->concat(swapXY);
+            polygon.canvas->drawRRect(GRect::LTRB(r.fTop, r.fLeft, r.fBottom, r.fRight),
+                                      shape.ry, shape.rx, paint);
+
+            // the polygon stays within 1/4 pixel of the ellipse, so only pixels along the
+            // edge can differ (& with AA, by about a quarter of their coverage at most)
+            float edgeLength = 2 * (r.width() + r.height());
+            if (aa) {
+                float rx = std::min(shape.rx, r.width() / 2);       // (as drawRRect pins them)
+                float ry = std::min(shape.ry, r.height() / 2);
+                float exact = r.width() * r.height() - (4 - (float)M_PI) * rx * ry;
+                areasMatch &= fabsf(covered_area(analytic) - exact) <= 0.01f * edgeLength &&
+                              fabsf(covered_area(polygon) - exact) <= 0.25f * edgeLength;
+                aaClose &= max_channel_diff(analytic, polygon) <= 0x50;
+            } else {
+                bwClose &= count_diff_pixels(analytic, polygon) <= 0.25f * edgeLength;
+            }
+        }
+    }
+    stats->expectTrue(areasMatch, "rrect_area_matches_ellipse");
+    stats->expectTrue(aaClose, "rrect_aa_matches_polygon");
+    stats->expectTrue(bwClose, "rrect_matches_polygon");
+
+    // drawOval & drawCircle are the round rect with the largest radii
+    TestCanvas oval(100, 100), rrect(100, 100);
+    GPaint paint(GColor::RGBA(0, 0.5f, 1, 1));
+    oval.canvas->drawOval(GRect::LTRB(10, 20, 90, 60), paint);
+    oval.canvas->drawCircle({50, 75}, 20, paint.setAntiAlias(true));
+    rrect.canvas->drawRRect(GRect::LTRB(10, 20, 90, 60), 40, 20, paint.setAntiAlias(false));
+    rrect.canvas->drawRRect(GRect::LTRB(30, 55, 70, 95), 20, 20, paint.setAntiAlias(true));
+    stats->expectTrue(same_pixels(oval, rrect), "oval_is_rrect");
+}
+
+// how far p is from the line segment a-b
+static float segment_distance(GPoint p, GPoint a, GPoint b) {
+    GPoint ab = b - a, ap = p - a;
+    float len2 = ab.fX * ab.fX + ab.fY * ab.fY;
+    float t = len2 > 0 ? std::max(0.0f, std::min(1.0f, (ap.fX * ab.fX + ap.fY * ab.fY) / len2))
+                       : 0;
+    return (ap - ab * t).length();
+}
+
+// the farthest that any point along the curve is from the lines it was flattened into
+static float flattening_error(const GPoint pts[], int count, float tolerance, int* lineCount) {
+    GPath path;
+    path.moveTo(pts[0]);
+    if (count == 3) {
+        path.quadTo(pts[1], pts[2]);
+    } else {
+        path.cubicTo(pts[1], pts[2], pts[3]);
+    }
+    std::vector<GPoint> lines;      // (each pair is one line)
+    GPath flat = path.flattened(tolerance);
+    GPath::Edger edger(flat);
+    GPoint line[2];
+    while (edger.next(line) == GPath::kLine) {
+        lines.push_back(line[0]);
+        lines.push_back(line[1]);
+    }
+    lines.resize(lines.size() - 2);     // (not the line that closes the contour)
+    *lineCount = (int)lines.size() / 2;
+
+    float error = 0;
+    for (int i = 0; i <= 1000; ++i) {
+        float t = i / 1000.0f, u = 1 - t;
+        GPoint p = count == 3
+                ? pts[0] * (u * u) + pts[1] * (2 * u * t) + pts[2] * (t * t)
+                : pts[0] * (u * u * u) + pts[1] * (3 * u * u * t) + pts[2] * (3 * u * t * t) +
+                  pts[3] * (t * t * t);
+        float nearest = INFINITY;
+        for (size_t j = 0; j < lines.size(); j += 2) {
+            nearest = std::min(nearest, segment_distance(p, lines[j], lines[j + 1]));
+        }
+        error = std::max(error, nearest);
+    }
+    return error;
+}
+
+static void test_curve_flattening(GTestStats* stats) {
+    // (what the canvas flattens to)
+    const float kTolerance = 0.25f;
+
+    // curves from a few pixels across to bigger than the device, with loops & cusps
+    bool withinTolerance = true, fewerWhenLooser = true;
+    uint32_t seed = 1;
+    for (int n = 0; n < 200; ++n) {
+        float size = n % 4 == 0 ? 4 : n % 4 == 1 ? 60 : n % 4 == 2 ? 400 : 3000;
+        GPoint pts[4];
+        for (GPoint& p : pts) {
+            p = {next_random(&seed) * (size / (1 << 24)), next_random(&seed) * (size / (1 << 24))};
+        }
+        for (int count : {3, 4}) {
+            int lines, looseLines;
+            withinTolerance &= flattening_error(pts, count, kTolerance, &lines) <=
+                               kTolerance * 1.01f;
+            flattening_error(pts, count, 4 * kTolerance, &looseLines);
+            fewerWhenLooser &= looseLines <= lines;
+        }
+    }
+    stats->expectTrue(withinTolerance, "curve_flattening_within_tolerance");
+    stats->expectTrue(fewerWhenLooser, "curve_flattening_fewer_lines_when_looser");
+
+    // a straight "curve" needs just the one line
+    const GPoint straight[4] = { {0, 0}, {10, 10}, {20, 20}, {30, 30} };
+    int lines;
+    flattening_error(straight, 4, kTolerance, &lines);
+    stats->expectEQ(lines, 1, "curve_flattening_straight");
+
+    // curves are flattened on the device, so drawing under a CTM is the same as drawing the
+    // path mapped by it
+    GPath curves;
+    curves.moveTo(2, 2).quadTo(30, 0, 20, 15).cubicTo(0, 30, 30, 30, 5, 20);
+    const GMatrix ctm = GMatrix::Translate(10, 5) * GMatrix::Scale(3, 2.5f);
+    GPath mapped = curves;
+    mapped.transform(ctm);
+    TestCanvas underCTM(100, 100), premapped(100, 100);
+    GPaint paint(GColor::RGBA(0.2f, 0.4f, 0.8f, 1));
+    paint.setAntiAlias(true);
+    underCTM.canvas->concat(ctm);
+    underCTM.canvas->drawPath(curves, paint);
+    premapped.canvas->drawPath(mapped, paint);
+    stats->expectTrue(same_pixels(underCTM, premapped), "curves_flattened_on_device");
+}
+
+// the pixel the plain sampling loop picks for device pixel [x, y]: map the center of the row's
+// first pixel, step across by the inverse's x column, & pin to the bitmap
+static GPixel reference_sample(const GBitmap& bm, const GMatrix& inverse, int x, int y) {
+    GPoint start = inverse * GPoint{0.5f, y + 0.5f};
+    GPoint local = {start.fX + inverse[0] * x, start.fY + inverse[3] * x};
+    int ix = (int)std::max(0.0f, std::min(floorf(local.fX), (float)bm.width() - 1));
+    int iy = (int)std::max(0.0f, std::min(floorf(local.fY), (float)bm.height() - 1));
+    return *bm.getAddr(ix, iy);
+}
+
+static void test_shader_fast_paths(GTestStats* stats) {
+    uint32_t seed = 1;
+    // (wide enough for whole chunks of a moved row to lie inside it)
+    std::vector<GPixel> storage(90 * 9);
+    for (GPixel& p : storage) {
+        p = random_pixel(&seed);
+    }
+    GBitmap bm(90, 9, 90 * sizeof(GPixel), storage.data(), false);
+
+    // whole pixel moves (even far off), part pixel moves & scales (which sample one bitmap
+    // row per device row), & a skew to check the reference itself against the general loop
+    const GMatrix ctms[] = {
+        GMatrix(), GMatrix::Translate(3, -2), GMatrix::Translate(-20, 40),
+        GMatrix::Translate(1 << 21, -(1 << 21)), GMatrix::Translate(0.5f, 0.25f),
+        GMatrix::Scale(2, 3), GMatrix::Scale(-1.5f, 0.75f),
+        GMatrix::Translate(5.5f, 1) * GMatrix::Scale(0.3f, 7),
+        GMatrix(1, 0.01f, 0, 0, 1, 0),
+    };
+    const GMatrix locals[] = { GMatrix(), GMatrix::Scale(0.25f, 0.25f), GMatrix::Translate(2, 3) };
+
+    bool rowsMatch = true, drawsMatch = true;
+    for (const GMatrix& local : locals) {
+        auto shader = GCreateBitmapShader(bm, local);
+        for (const GMatrix& ctm : ctms) {
+            GMatrix invCTM;
+            ctm.invert(&invCTM);
+            const GMatrix inverse = GMatrix::Concat(local, invCTM);
+
+            // spans of every length (past a chunk too), starting off either side of the bitmap
+            shader->setContext(ctm);
+            GPixel row[150];
+            for (int count : gRowCounts) {
+                for (int n = 0; n < 4; ++n) {
+                    int x = (int)(next_random(&seed) % 60) - 30;
+                    int y = (int)(next_random(&seed) % 30) - 10;
+                    shader->shadeRow(x, y, count, row);
+                    for (int i = 0; i < count; ++i) {
+                        rowsMatch &= row[i] == reference_sample(bm, inverse, x + i, y);
+                    }
+                }
+            }
+            shader->shadeRow(-30, 4, 150, row);
+            for (int i = 0; i < 150; ++i) {
+                rowsMatch &= row[i] == reference_sample(bm, inverse, -30 + i, 4);
+            }
+
+            // & through the canvas, which blends moved pixels straight from the bitmap (over
+            // nothing, so they come out as they went in)
+            TestCanvas test(100, 40);
+            test.canvas->concat(ctm);
+            test.canvas->drawPaint(GPaint(shader.get()));
+            for (int y = 0; y < 40; ++y) {
+                for (int x = 0; x < 100; ++x) {
+                    drawsMatch &= test.at(x, y) == reference_sample(bm, inverse, x, y);
+                }
+            }
+        }
+    }
+    stats->expectTrue(rowsMatch, "shader_fast_rows_match_general");
+    stats->expectTrue(drawsMatch, "shader_fast_draws_match_general");
+}
+
+static void test_sample_levels(GTestStats* stats) {
+    // a bitmap with padding at the end of each row, so the row stride isn't its width
+    uint32_t seed = 1;
+    const int W = 37, H = 23, kStride = W + 3;
+    std::vector<GPixel> storage(kStride * H);
+    for (GPixel& p : storage) {
+        p = random_pixel(&seed);
+    }
+    GBitmap bm(W, H, kStride * sizeof(GPixel), storage.data(), false);
+
+    // starts & steps that land in & around the bitmap, far past it, & on inf or NaN (which
+    // take the edge pixels like the scalar loop does)
+    const float kSpecials[] = { 1e9f, -1e9f, 3e38f, -3e38f, INFINITY, -INFINITY, NAN, 0 };
+    auto pick = [&](float range) {
+        unsigned kind = next_random(&seed) % 8;
+        if (kind == 0) return kSpecials[next_random(&seed) % 8];
+        return next_random(&seed) * (2 * range / (1 << 24)) - range;
+    };
+
+    GPixel expected[kMaxRowCount], actual[kMaxRowCount];
+    for (GFilterQuality quality : { GFilterQuality::kNearest, GFilterQuality::kBilinear,
+                                    GFilterQuality::kBicubic }) {
+        GSetCPULevel("scalar");
+        SampleRowProc scalarRow = GetSampleRowProc(quality);
+        bool rowsMatch = true;
+        for (int n = 0; n < 200; ++n) {
+            GPoint start = {pick(2 * W), pick(2 * H)};
+            GPoint step = {pick(2), pick(2)};
+            int x = (int)(next_random(&seed) % 200) - 100;
+            for (int count : gRowCounts) {
+                scalarRow(bm, start, step, x, count, expected);
+                for_each_simd_level([&]() {
+                    memset(actual, 0, sizeof(actual));
+                    GetSampleRowProc(quality)(bm, start, step, x, count, actual);
+                    rowsMatch &= memcmp(expected, actual, count * sizeof(GPixel)) == 0;
+                });
+            }
+        }
+        stats->expectTrue(rowsMatch, "sample_row_levels_match_scalar");
+    }
+}
@@ -12,6 +12,8 @@
 #include "tests_pa1.cpp"
 #include "tests_pa2.cpp"
 #include "tests_pa3.cpp"
+#include "tests_extra.cpp"
+#include "tests_threaded.cpp"
 
 const GTestRec gTestRecs[] = {
     { test_clear,       "clear"         },
@@ -24,6 +26,24 @@ const GTestRec gTestRecs[] = {
     { test_matrix_map,   "matrix_map"        },
     { test_clamp_shader, "shader_clamp"      },
 
+    { test_blend_levels, "blend_levels"      },
+    { test_path_fill_types, "path_fill_types" },
+    { test_aa_coverage,     "aa_coverage"     },
+
+    { test_threaded_shader_draws, "threaded_shader_draws" },
+    { test_threaded_aa_paths,     "threaded_aa_paths"     },
+    { test_threaded_shader_after_clip, "threaded_shader_after_clip" },
+    { test_aa_stroke_clip_invariance,  "aa_stroke_clip_invariance"  },
+
+    { test_picture_playback, "picture_playback" },
+    { test_picture_cull,     "picture_cull"     },
+
+    { test_clip_save_restore, "clip_save_restore" },
+    { test_rrect_matches_polygon, "rrect_matches_polygon" },
+    { test_curve_flattening,      "curve_flattening"      },
+    { test_shader_fast_paths,     "shader_fast_paths"     },
+    { test_sample_levels,         "sample_levels"         },
+
     { nullptr, nullptr },
 };
 
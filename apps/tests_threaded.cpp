@@ -0,0 +1,159 @@
+/**
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#include "../include/GPaint.h"
+#include "../include/GPath.h"
+#include "../include/GShader.h"
+
+#include <functional>
+#include <vector>
+
+// draws the same thing with the serial & threaded canvases, & checks they match exactly
+static bool threaded_matches_serial(int w, int h, const std::function<void(GCanvas*)>& draw) {
+    std::vector<GPixel> serialPixels(w * h, 0), threadedPixels(w * h, 0);
+    GBitmap serial(w, h, w * sizeof(GPixel), serialPixels.data(), false);
+    GBitmap threaded(w, h, w * sizeof(GPixel), threadedPixels.data(), false);
+
+    draw(GCreateCanvas(serial).get());
+    {
+        auto canvas = GCreateThreadedCanvas(threaded, 2);
+        draw(canvas.get());
+    }   // (flushed when it goes away)
+    return serialPixels == threadedPixels;
+}
+
+static GBitmap make_checker_bitmap(std::vector<GPixel>* storage) {
+    const GPixel R = GPixel_PackARGB(0xFF, 0xFF, 0, 0);
+    const GPixel B = GPixel_PackARGB(0x80, 0, 0, 0x80);
+    storage->resize(8 * 8);
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            (*storage)[y * 8 + x] = ((x ^ y) & 1) ? R : B;
+        }
+    }
+    return GBitmap(8, 8, 8 * sizeof(GPixel), storage->data(), false);
+}
+
+// a random float in [0, max)
+static float random_float(uint32_t* seed, float max) {
+    return next_random(seed) * (max / (1 << 24));
+}
+
+static void test_threaded_shader_draws(GTestStats* stats) {
+    std::vector<GPixel> storage;
+    GBitmap bm = make_checker_bitmap(&storage);
+    auto shader = GCreateBitmapShader(bm, GMatrix::Scale(0.25f, 0.25f));
+
+    GPath path;
+    path.moveTo(10, 10).lineTo(150, 30).lineTo(90, 140);
+    GPath path2;
+    path2.moveTo(20, 120).lineTo(100, 5).lineTo(180, 120).lineTo(100, 90);
+    const GPoint pts[] = { {5, 5}, {120, 20}, {70, 100},  {60, 60}, {190, 70}, {140, 140} };
+    const int counts[] = { 3, 0, 3 };
+
+    // solid draws leave entries in the recorded points & paths, which the shader draws after
+    // them must not point into once they've been flushed
+    stats->expectTrue(threaded_matches_serial(200, 150, [&](GCanvas* canvas) {
+        canvas->drawPath(path, GPaint(GColor::RGBA(0, 1, 0, 1)));
+        canvas->drawPath(path2, GPaint(shader.get()));
+        canvas->drawConvexPolygons(pts, counts, 3, GPaint(GColor::RGBA(0, 0, 1, 0.5f)));
+        canvas->drawConvexPolygons(pts, counts, 3, GPaint(shader.get()));
+        canvas->save();
+        canvas->concat(GMatrix::Translate(7, 3));
+        canvas->drawPath(path, GPaint(shader.get()).setAntiAlias(true));
+        canvas->restore();
+        canvas->drawRRect(GRect::LTRB(20, 30, 180, 140), 30, 20, GPaint(shader.get()));
+    }), "threaded_shader_paths_polys");
+
+    // empty polygons are skipped, even when nothing else has been recorded
+    const int empty[] = { 0, -1 };
+    stats->expectTrue(threaded_matches_serial(200, 150, [&](GCanvas* canvas) {
+        canvas->drawConvexPolygons(pts, empty, 2, GPaint(GColor::RGBA(1, 0, 0, 1)));
+    }), "threaded_empty_polys");
+}
+
+static void test_threaded_aa_paths(GTestStats* stats) {
+    // the tiles start drawing partway down the paths (at their own top rows), & still have
+    // to get exactly the same coverage there
+    bool matches = true;
+    uint32_t seed = 1;
+    for (int n = 0; n < 100; ++n) {
+        GPath path;
+        path.moveTo(random_float(&seed, 200), random_float(&seed, 150));
+        for (int i = 0; i < 6; ++i) {
+            path.lineTo(random_float(&seed, 200), random_float(&seed, 150));
+        }
+        GPaint paint(GColor::RGBA(0.2f, 0.6f, 0.9f, 0.8f));
+        paint.setAntiAlias(true);
+        matches &= threaded_matches_serial(200, 150, [&](GCanvas* canvas) {
+            canvas->drawPath(path, paint);
+        });
+    }
+    stats->expectTrue(matches, "threaded_aa_paths_match_serial");
+}
+
+static void test_threaded_shader_after_clip(GTestStats* stats) {
+    std::vector<GPixel> storage;
+    GBitmap bm = make_checker_bitmap(&storage);
+    auto shader = GCreateBitmapShader(bm, GMatrix::Scale(0.25f, 0.25f));
+
+    // the shader draw's flush drops the popped clip & renumbers the rest, which must happen
+    // before the draw takes its clip from the state
+    stats->expectTrue(threaded_matches_serial(200, 150, [&](GCanvas* canvas) {
+        canvas->save();
+        canvas->clipRect(GRect::LTRB(10, 10, 60, 60));
+        canvas->restore();
+        canvas->clipRect(GRect::LTRB(30, 20, 170, 130));
+        canvas->drawRect(GRect::LTRB(0, 0, 200, 150), GPaint(shader.get()));
+        canvas->save();
+        GPath tri;
+        tri.moveTo(0, 0).lineTo(200, 0).lineTo(0, 150);
+        canvas->clipPath(tri, true);
+        canvas->drawPaint(GPaint(GColor::RGBA(0, 1, 0, 0.5f)));
+        canvas->restore();
+        canvas->drawPaint(GPaint(shader.get()).setBlendMode(GBlendMode::kDstOver));
+    }), "threaded_shader_after_clip");
+}
+
+static void test_aa_stroke_clip_invariance(GTestStats* stats) {
+    const int W = 200, H = 150;
+    const GRect clip = GRect::LTRB(13, 37, 171, 119);
+
+    // a stroke's pieces have collinear edges that wind opposite ways, which have to come out
+    // in the same order wherever the edges start being walked
+    bool clipMatches = true, threadedMatches = true;
+    uint32_t seed = 1;
+    for (int n = 0; n < 100; ++n) {
+        GPath path;
+        path.moveTo(random_float(&seed, W), random_float(&seed, H));
+        for (int i = 0; i < 12; ++i) {
+            path.lineTo(random_float(&seed, W), random_float(&seed, H));
+        }
+        GPaint paint(GColor::RGBA(0.2f, 0.6f, 0.9f, 0.8f));
+        paint.setAntiAlias(true).setStroke(true).setStrokeWidth(1 + random_float(&seed, 12));
+        // (every join & cap, since each one adds its own pieces)
+        paint.setStrokeJoin((GStrokeJoin)(n % 3)).setStrokeCap((GStrokeCap)(n / 3 % 3));
+
+        // clipping only drops pixels, it never changes the ones it keeps
+        std::vector<GPixel> fullPixels(W * H, 0), clippedPixels(W * H, 0);
+        GBitmap full(W, H, W * sizeof(GPixel), fullPixels.data(), false);
+        GBitmap clipped(W, H, W * sizeof(GPixel), clippedPixels.data(), false);
+        GCreateCanvas(full)->drawPath(path, paint);
+        auto canvas = GCreateCanvas(clipped);
+        canvas->clipRect(clip);
+        canvas->drawPath(path, paint);
+        for (int y = (int)clip.fTop; y < (int)clip.fBottom; ++y) {
+            for (int x = (int)clip.fLeft; x < (int)clip.fRight; ++x) {
+                clipMatches &= fullPixels[y * W + x] == clippedPixels[y * W + x];
+            }
+        }
+
+        // (& so the threaded canvas, which clips to its tiles, draws the same pixels)
+        threadedMatches &= threaded_matches_serial(W, H, [&](GCanvas* canvas) {
+            canvas->drawPath(path, paint);
+        });
+    }
+    stats->expectTrue(clipMatches, "aa_stroke_clip_invariance");
+    stats->expectTrue(threadedMatches, "aa_stroke_threaded_matches_serial");
+}
@@ -10,6 +10,8 @@
 #include <string>
 
 class GBitmap;
+class GIRect;
+class GPath;
 class GPoint;
 class GRect;
 
@@ -44,6 +46,23 @@ public:
      */
     virtual void concat(const GMatrix& matrix) = 0;
 
+    /**
+     *  Intersects the clip with the rectangle (mapped by the CTM). Only pixels inside the clip
+     *  are changed by later draws. Like the CTM, the clip is saved by save() & put back by
+     *  restore(). The canvas starts out clipped to its bitmap.
+     *
+     *  When the CTM keeps the rectangle axis-aligned, the clip keeps the pixels whose centers
+     *  are inside it (the same ones drawRect would fill).
+     */
+    virtual void clipRect(const GRect&) = 0;
+
+    /**
+     *  Intersects the clip with the path (mapped by the CTM), using the path's fill type. If
+     *  antiAlias is true, pixels on the path's edges are only partly inside the clip, & later
+     *  draws only change them by how much of them is inside.
+     */
+    virtual void clipPath(const GPath&, bool antiAlias) = 0;
+
     /**
      *  Fill the entire canvas with the specified color, using the specified blendmode.
      */
@@ -54,6 +73,11 @@ public:
      *
      *  The affected pixels are those whose centers are "contained" inside the rectangle:
      *      e.g. contained == center > min_edge && center <= max_edge
+     *
+     *  If the paint is a stroke (GPaint::isStroke()), this & the other shape draws below fill
+     *  the area around the shape's outline instead, with the paint's stroke width, joins &
+     *  caps. The whole outline is filled at once, so parts of it that overlap are only blended
+     *  once.
      */
     virtual void drawRect(const GRect&, const GPaint&) = 0;
 
@@ -63,6 +87,44 @@ public:
      */
     virtual void drawConvexPolygon(const GPoint[], int count, const GPaint&) = 0;
 
+    /**
+     *  Fill polyCount convex polygons with the same paint. The points of all the polygons
+     *  are one after the other in points[], with counts[i] points in polygon i. The same as
+     *  drawing each one with drawConvexPolygon(), but canvases can set up the paint just once.
+     */
+    virtual void drawConvexPolygons(const GPoint points[], const int counts[], int polyCount,
+                                    const GPaint& paint) {
+        for (int i = 0; i < polyCount; ++i) {
+            this->drawConvexPolygon(points, counts[i], paint);
+            points += counts[i];
+        }
+    }
+
+    /**
+     *  Fill the round rect: the rectangle with each of its corners rounded off by a quarter of
+     *  the ellipse with radii rx & ry (pinned to half of the rectangle's width & height). Radii
+     *  of 0 give the plain rectangle, & radii of half its width & height give an oval.
+     */
+    virtual void drawRRect(const GRect&, float rx, float ry, const GPaint&) = 0;
+
+    /**
+     *  Fill the path with the paint, using the path's fill type to decide which areas are
+     *  inside it. The path may be concave, self-intersecting & have any number of contours.
+     */
+    virtual void drawPath(const GPath&, const GPaint&) = 0;
+
+    /**
+     *  Finish any drawing the canvas has put off, so the bitmap's pixels are up to date.
+     *  Canvases that draw right away have nothing to do.
+     */
+    virtual void flush() {}
+
+    /**
+     *  If the canvas draws into pixels, sets ctm to its CTM & bounds to the pixels that draws
+     *  can change, & returns true. Canvases that don't (like a recording canvas) return false.
+     */
+    virtual bool getDeviceState(GMatrix* ctm, GIRect* bounds) const { return false; }
+
     // Helpers
 
     void translate(float x, float y) {
@@ -86,6 +148,19 @@ public:
     void drawRect(const GRect& rect, const GColor& color) {
         this->drawRect(rect, GPaint(color));
     }
+
+    // fills the oval that just fits inside the rect
+    void drawOval(const GRect& rect, const GPaint& paint) {
+        this->drawRRect(rect, fabsf(rect.width()) / 2, fabsf(rect.height()) / 2, paint);
+    }
+
+    void drawCircle(GPoint center, float radius, const GPaint& paint) {
+        this->drawOval(GRect::LTRB(center.fX - radius, center.fY - radius,
+                                   center.fX + radius, center.fY + radius), paint);
+    }
+
+    // strokes the line p0 -> p1 with the paint (whether or not the paint is a stroke)
+    void drawLine(GPoint p0, GPoint p1, const GPaint& paint);
 };
 
 /**
@@ -94,6 +169,28 @@ public:
  */
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap);
 
+/**
+ *  Like GCreateCanvas, but the draws are sorted into tiles of the bitmap, which are drawn in
+ *  parallel by a pool of threads (counting the caller's) when the canvas is flushed or
+ *  destroyed. Each tile draws in the same order, so the pixels are exactly the same as with
+ *  GCreateCanvas. Shaders must be safe to call shadeRow() on from several threads at once.
+ */
+std::unique_ptr<GCanvas> GCreateThreadedCanvas(const GBitmap& bitmap, int threads);
+
+/**
+ *  Returns the name of the instruction set ("scalar", "sse2", "avx2" or "avx512") whose raster
+ *  kernels the canvases from GCreateCanvas are using. This is picked once, the first time it
+ *  is needed, as the fastest one the CPU supports.
+ */
+const char* GGetCPULevel();
+
+/**
+ *  Force the raster kernels to use the named instruction set (e.g. for testing the slower
+ *  paths). Returns false, and changes nothing, if the name is unknown or the CPU can't run it.
+ *  Setting the G_CPU_LEVEL environment variable does the same thing at startup.
+ */
+bool GSetCPULevel(const char name[]);
+
 /**
  *  Implement this, drawing into the provided canvas, and returning the title of your artwork.
  */
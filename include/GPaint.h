@@ -10,6 +10,20 @@
 
 class GShader;
 
+// how a stroke goes around the corners where its lines meet
+enum class GStrokeJoin {
+    kMiter,     // out to a point (or beveled, if the point is past the miter limit)
+    kRound,     // around a circle
+    kBevel,     // cut straight across
+};
+
+// how a stroke ends at the ends of an open contour
+enum class GStrokeCap {
+    kButt,      // right at the end
+    kRound,     // with a half circle past the end
+    kSquare,    // with half a square past the end
+};
+
 class GPaint {
 public:
     GPaint() {}
@@ -34,10 +48,39 @@ public:
     GShader* getShader() const { return fShader; }
     GPaint&  setShader(GShader* s) { fShader = s; return *this; }
 
+    // when true, the edges of filled shapes are blended by how much of each pixel they cover
+    bool    isAntiAlias() const { return fAntiAlias; }
+    GPaint& setAntiAlias(bool aa) { fAntiAlias = aa; return *this; }
+
+    // when true, shapes are drawn as their outlines, stroked with the settings below, instead
+    // of being filled
+    bool    isStroke() const { return fStroke; }
+    GPaint& setStroke(bool stroke) { fStroke = stroke; return *this; }
+
+    // how wide strokes are (in the same space as the shapes, so the CTM scales them too)
+    float   getStrokeWidth() const { return fStrokeWidth; }
+    GPaint& setStrokeWidth(float width) { fStrokeWidth = width; return *this; }
+
+    GStrokeJoin getStrokeJoin() const { return fJoin; }
+    GPaint&     setStrokeJoin(GStrokeJoin join) { fJoin = join; return *this; }
+
+    GStrokeCap getStrokeCap() const { return fCap; }
+    GPaint&    setStrokeCap(GStrokeCap cap) { fCap = cap; return *this; }
+
+    // miter joins that would reach more than this many half widths out are beveled instead
+    float   getMiterLimit() const { return fMiterLimit; }
+    GPaint& setMiterLimit(float limit) { fMiterLimit = limit; return *this; }
+
 private:
     GColor      fColor = {0, 0, 0, 1};
     GShader*    fShader = nullptr;
     GBlendMode  fMode = GBlendMode::kSrcOver;
+    bool        fAntiAlias = false;
+    bool        fStroke = false;
+    float       fStrokeWidth = 1;
+    GStrokeJoin fJoin = GStrokeJoin::kMiter;
+    GStrokeCap  fCap = GStrokeCap::kButt;
+    float       fMiterLimit = 4;
 };
 
 #endif
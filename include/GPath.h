@@ -0,0 +1,180 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef GPath_DEFINED
+#define GPath_DEFINED
+
+#include "GMatrix.h"
+#include "GPoint.h"
+#include "GRect.h"
+#include <vector>
+
+/**
+ *  How a path decides which areas are inside it, from the winding number of a point (the
+ *  number of times the path's edges go around it, counting down-going edges as +1 & up-going
+ *  edges as -1).
+ */
+enum class GPathFillType {
+    kWinding,   // inside if the winding number is not 0
+    kEvenOdd,   // inside if the winding number is odd
+};
+
+/**
+ *  A path is made of any number of contours, each one starting with moveTo() & followed by
+ *  lines & curves. When a path is filled, every contour is treated as closed (whether or not
+ *  close() was called), so contours can overlap, have holes & be concave.
+ */
+class GPath {
+public:
+    GPath() : fFillType(GPathFillType::kWinding) {}
+
+    enum Verb {
+        kMove,  // starts a contour
+        kLine,  // a line from the last point (Edger returns it in pts[0..1])
+        kQuad,  // a quadratic curve from the last point, with 1 control point & its end
+        kCubic, // a cubic curve from the last point, with 2 control points & its end
+        kDone,  // Edger has no more lines
+    };
+
+    GPathFillType getFillType() const { return fFillType; }
+    void setFillType(GPathFillType type) { fFillType = type; }
+
+    // erase any previous points & verbs, leaving the path empty
+    GPath& reset() {
+        fPts.clear();
+        fVbs.clear();
+        return *this;
+    }
+
+    // starts a new contour at p
+    GPath& moveTo(GPoint p) {
+        fPts.push_back(p);
+        fVbs.push_back(kMove);
+        return *this;
+    }
+    GPath& moveTo(float x, float y) { return this->moveTo({x, y}); }
+
+    // adds a line from the last point to p (starting a contour at p if there isn't one yet)
+    GPath& lineTo(GPoint p) {
+        if (fVbs.empty()) return this->moveTo(p);
+        fPts.push_back(p);
+        fVbs.push_back(kLine);
+        return *this;
+    }
+    GPath& lineTo(float x, float y) { return this->lineTo({x, y}); }
+
+    // adds a quadratic curve from the last point, pulled toward p1, to p2 (starting a contour
+    // at p1 if there isn't one yet)
+    GPath& quadTo(GPoint p1, GPoint p2) {
+        if (fVbs.empty()) this->moveTo(p1);
+        fPts.push_back(p1);
+        fPts.push_back(p2);
+        fVbs.push_back(kQuad);
+        return *this;
+    }
+    GPath& quadTo(float x1, float y1, float x2, float y2) {
+        return this->quadTo({x1, y1}, {x2, y2});
+    }
+
+    // adds a cubic curve from the last point, pulled toward p1 & then p2, to p3 (starting a
+    // contour at p1 if there isn't one yet)
+    GPath& cubicTo(GPoint p1, GPoint p2, GPoint p3) {
+        if (fVbs.empty()) this->moveTo(p1);
+        fPts.push_back(p1);
+        fPts.push_back(p2);
+        fPts.push_back(p3);
+        fVbs.push_back(kCubic);
+        return *this;
+    }
+    GPath& cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+        return this->cubicTo({x1, y1}, {x2, y2}, {x3, y3});
+    }
+
+    // adds a line back to the start of the current contour
+    GPath& close();
+
+    int countPoints() const { return (int)fPts.size(); }
+
+    // the smallest rect that holds all of the points, including curves' control points (so
+    // the curves are inside it too), or all zeros if there are none
+    GRect bounds() const;
+
+    // maps every point by the matrix
+    void transform(const GMatrix&);
+
+    bool hasCurves() const;
+
+    /**
+     *  Returns a copy of the path with each curve replaced by lines, just enough of them that
+     *  none is more than tolerance away from the curve. (Fill the path in device space, &
+     *  tolerance is in pixels.)
+     */
+    GPath flattened(float tolerance) const;
+
+    /**
+     *  Walks the lines of every contour, including the line that closes each contour
+     *  (unless it would be empty). Curves come out as a single line to their end, so flatten
+     *  a path with curves first.
+     *
+     *  GPath::Edger edger(path);
+     *  GPoint pts[2];
+     *  while (edger.next(pts) == GPath::kLine) {
+     *      ... pts[0] -> pts[1]
+     *  }
+     */
+    class Edger {
+    public:
+        Edger(const GPath& path)
+            : fPath(path), fPtIndex(0), fVbIndex(0), fInContour(false) {}
+
+        // kLine with the next line in pts[0..1], or kDone when there are no more
+        Verb next(GPoint pts[]);
+
+    private:
+        const GPath& fPath;
+        int fPtIndex;
+        int fVbIndex;
+        GPoint fContourStart;
+        GPoint fLast;
+        bool fInContour;    // true once a contour has been started (& isn't closed yet)
+    };
+
+    /**
+     *  Walks the contours, as the points they were made from (not closed, unless the last
+     *  point was added on top of the first, the way close() does). Curves' control points are
+     *  in there too, so flatten a path with curves first.
+     *
+     *  GPath::Contourer contourer(path);
+     *  const GPoint* pts;
+     *  int count;
+     *  while ((count = contourer.next(&pts)) > 0) {
+     *      ... pts[0 ... count - 1]
+     *  }
+     */
+    class Contourer {
+    public:
+        Contourer(const GPath& path) : fPath(path), fVbIndex(0), fPtIndex(0) {}
+
+        // the number of points in the next contour (pointed to by *pts), or 0 when there are
+        // no more
+        int next(const GPoint** pts);
+
+    private:
+        const GPath& fPath;
+        int fVbIndex;   // of the next contour's move
+        int fPtIndex;   // & its point
+    };
+
+    // the number of points that go with the verb
+    static int PointCount(Verb verb) {
+        return verb == kQuad ? 2 : verb == kCubic ? 3 : 1;
+    }
+
+private:
+    std::vector<GPoint> fPts;
+    std::vector<Verb> fVbs;
+    GPathFillType fFillType;
+};
+
+#endif
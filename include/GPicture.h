@@ -0,0 +1,66 @@
+/*
+ *  Copyright 2023 Georgie Stammer
+ */
+
+#ifndef GPicture_DEFINED
+#define GPicture_DEFINED
+
+#include "GCanvas.h"
+#include <cstdint>
+#include <memory>
+
+// the work that GPicture::playback() skipped, because later draws covered it up
+struct GPictureStats {
+    int culledDraws = 0;        // draws that were left out
+    int trimmedDraws = 0;       // rects that were cut down to the part still showing
+    int64_t pixelsSaved = 0;    // pixels not drawn (for non-rects, by their bounds)
+};
+
+/**
+ *  A recorded list of canvas calls (save, restore, concat, clips & draws) that can be played
+ *  back into any canvas, any number of times. Paints are recorded as they are, so the shaders
+ *  they point to must live as long as the picture.
+ */
+class GPicture {
+public:
+    virtual ~GPicture() {}
+
+    /**
+     *  Makes the recorded calls on the canvas, on top of its current CTM (so a picture can be
+     *  drawn scaled or moved by concat-ing first). The CTM is left as it was.
+     *
+     *  If the canvas can say where its draws land (GCanvas::getDeviceState), draws that are
+     *  completely painted over by later opaque rects are skipped, & rects that are partly
+     *  painted over are cut down, without changing any pixels. If stats isn't null, it's set
+     *  to how much was skipped.
+     */
+    virtual void playback(GCanvas* canvas, GPictureStats* stats = nullptr) const = 0;
+
+    // the number of calls that were recorded
+    virtual int count() const = 0;
+};
+
+/**
+ *  Makes a picture from the calls made on its canvas:
+ *
+ *  GPictureRecorder recorder;
+ *  GCanvas* canvas = recorder.beginRecording();
+ *  ... draw into canvas
+ *  std::unique_ptr<GPicture> picture = recorder.finishRecording();
+ */
+class GPictureRecorder {
+public:
+    /**
+     *  Starts a new recording. The canvas belongs to the recorder, & can be used until
+     *  finishRecording() is called.
+     */
+    GCanvas* beginRecording();
+
+    // returns everything recorded since beginRecording() (or nullptr if it wasn't called)
+    std::unique_ptr<GPicture> finishRecording();
+
+private:
+    std::unique_ptr<GCanvas> fCanvas;
+};
+
+#endif
@@ -32,10 +32,18 @@ public:
     virtual void shadeRow(int x, int y, int count, GPixel row[]) = 0;
 };
 
+// how a bitmap shader picks colors for points between the centers of the bitmap's pixels
+enum class GFilterQuality {
+    kNearest,   // the pixel the point is in (blocky when scaled up)
+    kBilinear,  // a blend of the 4 pixels around the point
+    kBicubic,   // a smooth (Mitchell) curve through the 16 pixels around the point
+};
+
 /**
  *  Return a subclass of GShader that draws the specified bitmap and the local inverse.
  *  Returns null if the either parameter is invalid.
  */
-std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& localInverse);
+std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& localInverse,
+                                             GFilterQuality = GFilterQuality::kNearest);
 
 #endif